@@ -0,0 +1,73 @@
+#include "base64.h"
+
+#include <cstdint>
+
+namespace base64 {
+
+namespace {
+constexpr char BASE64_ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void AppendBase64(const unsigned char* bytes, std::string& output) {
+  const uint32_t group = bytes[0] << 16 | bytes[1] << 8 | bytes[2];
+  const char chars[] = {BASE64_ALPHABET[group >> 18],
+                        BASE64_ALPHABET[(group >> 12) & 63],
+                        BASE64_ALPHABET[(group >> 6) & 63],
+                        BASE64_ALPHABET[group & 63]};
+  output.append(chars, 4);
+}
+}  // namespace
+
+Base64Buffer::~Base64Buffer() { Finish(); }
+
+void Base64Buffer::Finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  if (tail_size_ == 0) {
+    return;
+  }
+  for (size_t i = tail_size_; i < 3; ++i) {
+    tail_[i] = 0;
+  }
+  AppendBase64(tail_, output_);
+  for (size_t i = tail_size_; i < 3; ++i) {
+    output_[output_.size() - 3 + i] = '=';
+  }
+  tail_size_ = 0;
+}
+
+void Base64Buffer::Write(std::string_view value) {
+  const auto* bytes = reinterpret_cast<const unsigned char*>(value.data());
+  size_t size = value.size();
+  while (tail_size_ > 0 && tail_size_ < 3 && size > 0) {
+    tail_[tail_size_++] = *bytes++;
+    --size;
+  }
+  if (tail_size_ == 3) {
+    AppendBase64(tail_, output_);
+    tail_size_ = 0;
+  }
+  for (; size >= 3; bytes += 3, size -= 3) {
+    AppendBase64(bytes, output_);
+  }
+  for (; size > 0; --size) {
+    tail_[tail_size_++] = *bytes++;
+  }
+}
+
+Base64Buffer::int_type Base64Buffer::overflow(int_type c) {
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    const char ch = traits_type::to_char_type(c);
+    Write({&ch, 1});
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize Base64Buffer::xsputn(const char* s, std::streamsize n) {
+  Write({s, static_cast<size_t>(n)});
+  return n;
+}
+
+}  // namespace base64
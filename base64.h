@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace base64 {
+
+// Буфер потока, который кодирует всё записанное в base64 и дописывает
+// в конец output. Неполная тройка байт в конце дописывается с выравниванием
+// в Finish или деструкторе. Результат можно класть в строку JSON
+// как есть, без экранирования.
+class Base64Buffer : public std::streambuf {
+ public:
+  explicit Base64Buffer(std::string& output) : output_(output) {}
+
+  Base64Buffer(const Base64Buffer&) = delete;
+  Base64Buffer& operator=(const Base64Buffer&) = delete;
+
+  ~Base64Buffer() override;
+
+  void Finish();
+
+ protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+  void Write(std::string_view value);
+
+  std::string& output_;
+  unsigned char tail_[3] = {};
+  size_t tail_size_ = 0;
+  bool finished_ = false;
+};
+
+}  // namespace base64
@@ -0,0 +1,496 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+
+namespace graph {
+
+// Иерархия сжатий (contraction hierarchies) поверх DirectedWeightedGraph.
+// Вершины сжимаются по возрастанию приоритета (разность рёбер + число уже
+// сжатых соседей), при сжатии добавляются ярлыки, если свидетельский поиск
+// не нашёл обходного пути не длиннее. Когда остаток графа становится плотным,
+// сжатие останавливается: несжатые вершины образуют ядро с общим рангом.
+// Запрос — двунаправленный Дейкстра по рёбрам, ведущим вверх по рангу (внутри
+// ядра — по всем рёбрам); найденные ярлыки разворачиваются в рёбра исходного
+// графа, так что ответ совпадает с Router по весу.
+template <typename Weight>
+class ContractionHierarchy {
+ private:
+  using Graph = DirectedWeightedGraph<Weight>;
+
+ public:
+  using RouteInfo = typename Router<Weight>::RouteInfo;
+
+  explicit ContractionHierarchy(const Graph& graph);
+
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+  // Число рёбер иерархии: исходные рёбра без дублей плюс ярлыки
+  size_t GetEdgeCount() const { return edges_.size(); }
+
+  size_t GetShortcutCount() const { return shortcut_count_; }
+
+  // Память под рёбра и индексы запроса, байт
+  size_t GetMemoryUsage() const;
+
+ private:
+  static constexpr EdgeId NONE = std::numeric_limits<EdgeId>::max();
+  // Ограничение свидетельского поиска: число извлечённых из кучи вершин
+  static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+  // Порог степени вершины, после которого остаток графа считается ядром
+  static constexpr size_t CORE_DEGREE_LIMIT = 100;
+
+  struct ChEdge {
+    VertexId from;
+    VertexId to;
+    Weight weight;
+    EdgeId original;  // NONE для ярлыка
+    EdgeId first;     // части ярлыка в edges_
+    EdgeId second;
+  };
+
+  // Рёбра вершины в порядке CSR: arcs_[offsets_[v]..offsets_[v + 1])
+  struct Adjacency {
+    std::vector<size_t> offsets;
+    std::vector<EdgeId> arcs;
+
+    Range<std::vector<EdgeId>::const_iterator> Get(VertexId vertex) const {
+      return {arcs.begin() + offsets[vertex],
+              arcs.begin() + offsets[vertex + 1]};
+    }
+  };
+
+  struct SearchSpace {
+    std::vector<Weight> weights;
+    std::vector<EdgeId> prev_edges;
+    std::vector<char> reached;
+    std::vector<VertexId> touched;
+    std::vector<std::pair<Weight, VertexId>> heap;
+
+    void Prepare(size_t vertex_count);
+    bool Relax(VertexId vertex, Weight weight, EdgeId prev_edge);
+    void Reset();
+  };
+
+  class Builder;
+
+  static std::pair<SearchSpace, SearchSpace>& GetWorkspace();
+
+  void Unpack(EdgeId edge, std::vector<EdgeId>& out) const;
+
+  const Graph& graph_;
+  std::vector<ChEdge> edges_;
+  size_t shortcut_count_ = 0;
+  Adjacency up_;    // рёбра from -> to, rank(to) > rank(from), по from
+  Adjacency down_;  // рёбра from -> to, rank(from) > rank(to), по to
+};
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::SearchSpace::Prepare(size_t vertex_count) {
+  if (reached.size() < vertex_count) {
+    weights.resize(vertex_count);
+    prev_edges.resize(vertex_count, NONE);
+    reached.resize(vertex_count, false);
+  }
+}
+
+template <typename Weight>
+bool ContractionHierarchy<Weight>::SearchSpace::Relax(VertexId vertex,
+                                                     Weight weight,
+                                                     EdgeId prev_edge) {
+  if (reached[vertex] && !(weight < weights[vertex])) {
+    return false;
+  }
+  if (!reached[vertex]) {
+    reached[vertex] = true;
+    touched.push_back(vertex);
+  }
+  weights[vertex] = weight;
+  prev_edges[vertex] = prev_edge;
+  heap.push_back({weight, vertex});
+  std::push_heap(heap.begin(), heap.end(),
+                 std::greater<std::pair<Weight, VertexId>>{});
+  return true;
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::SearchSpace::Reset() {
+  for (VertexId vertex : touched) {
+    reached[vertex] = false;
+    prev_edges[vertex] = NONE;
+  }
+  touched.clear();
+  heap.clear();
+}
+
+template <typename Weight>
+std::pair<typename ContractionHierarchy<Weight>::SearchSpace,
+          typename ContractionHierarchy<Weight>::SearchSpace>&
+ContractionHierarchy<Weight>::GetWorkspace() {
+  thread_local std::pair<SearchSpace, SearchSpace> workspace;
+  return workspace;
+}
+
+// Сжатие вершин. Живёт только во время построения иерархии.
+template <typename Weight>
+class ContractionHierarchy<Weight>::Builder {
+ public:
+  Builder(const Graph& graph, std::vector<ChEdge>& edges)
+      : edges_(edges),
+        out_(graph.GetVertexCount()),
+        in_(graph.GetVertexCount()),
+        contracted_(graph.GetVertexCount(), false),
+        deleted_neighbours_(graph.GetVertexCount(), 0),
+        rank_(graph.GetVertexCount(), 0) {
+    for (EdgeId id = 0; id < graph.GetEdgeCount(); ++id) {
+      const auto& edge = graph.GetEdge(id);
+      if (edge.from == edge.to) {
+        continue;
+      }
+      AddEdge({edge.from, edge.to, edge.weight, id, NONE, NONE});
+    }
+  }
+
+  std::vector<size_t> Contract() {
+    const size_t vertex_count = contracted_.size();
+    using Entry = std::pair<long, VertexId>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      queue.push({Priority(vertex), vertex});
+    }
+
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+      const VertexId vertex = queue.top().second;
+      queue.pop();
+      if (contracted_[vertex]) {
+        continue;
+      }
+      // Ленивое обновление: если приоритет вырос, вершина ждёт своей очереди
+      const long priority = Priority(vertex);
+      if (!queue.empty() && priority > queue.top().first) {
+        queue.push({priority, vertex});
+        continue;
+      }
+      // Остаток графа стал плотным: дальше сжатие дорогое и почти
+      // не ускоряет запросы, оставляем его ядром
+      if (last_degree_ > CORE_DEGREE_LIMIT) {
+        break;
+      }
+      ContractVertex(vertex);
+      rank_[vertex] = next_rank++;
+    }
+    // Несжатое ядро: у всех вершин один ранг выше остальных
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      if (!contracted_[vertex]) {
+        rank_[vertex] = vertex_count;
+      }
+    }
+    return rank_;
+  }
+
+ private:
+  struct Shortcut {
+    VertexId from;
+    VertexId to;
+    Weight weight;
+    EdgeId first;
+    EdgeId second;
+  };
+
+  // Если уже есть ребро не тяжелее, новое не нужно
+  void AddEdge(const ChEdge& edge) {
+    for (EdgeId id : out_[edge.from]) {
+      if (edges_[id].to == edge.to && !(edge.weight < edges_[id].weight)) {
+        return;
+      }
+    }
+    edges_.push_back(edge);
+    out_[edge.from].push_back(edges_.size() - 1);
+    in_[edge.to].push_back(edges_.size() - 1);
+  }
+
+  long Priority(VertexId vertex) {
+    size_t degree = 0;
+    for (EdgeId id : in_[vertex]) {
+      degree += !contracted_[edges_[id].from];
+    }
+    for (EdgeId id : out_[vertex]) {
+      degree += !contracted_[edges_[id].to];
+    }
+    pending_ = FindShortcuts(vertex);
+    last_degree_ = degree;
+    return 2 * (static_cast<long>(pending_.size()) -
+                static_cast<long>(degree)) +
+           deleted_neighbours_[vertex];
+  }
+
+  // Использует ярлыки, найденные последним вызовом Priority(vertex)
+  void ContractVertex(VertexId vertex) {
+    for (const Shortcut& shortcut : pending_) {
+      AddEdge({shortcut.from, shortcut.to, shortcut.weight, NONE,
+               shortcut.first, shortcut.second});
+    }
+    contracted_[vertex] = true;
+    // Убираем рёбра сжатой вершины из списков соседей, чтобы следующие
+    // свидетельские поиски не просматривали их
+    auto drop = [this](std::vector<EdgeId>& list, auto is_dropped) {
+      list.erase(std::remove_if(list.begin(), list.end(), is_dropped),
+                 list.end());
+    };
+    for (EdgeId id : in_[vertex]) {
+      const VertexId from = edges_[id].from;
+      ++deleted_neighbours_[from];
+      drop(out_[from], [&](EdgeId e) { return edges_[e].to == vertex; });
+    }
+    for (EdgeId id : out_[vertex]) {
+      const VertexId to = edges_[id].to;
+      ++deleted_neighbours_[to];
+      drop(in_[to], [&](EdgeId e) { return edges_[e].from == vertex; });
+    }
+  }
+
+  std::vector<Shortcut> FindShortcuts(VertexId vertex) {
+    std::vector<Shortcut> shortcuts;
+    Weight max_out{};
+    bool has_out = false;
+    for (EdgeId out_id : out_[vertex]) {
+      if (!contracted_[edges_[out_id].to]) {
+        max_out = has_out ? std::max(max_out, edges_[out_id].weight)
+                          : edges_[out_id].weight;
+        has_out = true;
+      }
+    }
+    if (!has_out) {
+      return shortcuts;
+    }
+
+    std::vector<VertexId> targets;
+    for (EdgeId out_id : out_[vertex]) {
+      if (!contracted_[edges_[out_id].to]) {
+        targets.push_back(edges_[out_id].to);
+      }
+    }
+
+    for (EdgeId in_id : in_[vertex]) {
+      const ChEdge& in_edge = edges_[in_id];
+      if (contracted_[in_edge.from]) {
+        continue;
+      }
+      WitnessSearch(in_edge.from, vertex, in_edge.weight + max_out, targets);
+      for (EdgeId out_id : out_[vertex]) {
+        const ChEdge& out_edge = edges_[out_id];
+        if (contracted_[out_edge.to] || out_edge.to == in_edge.from) {
+          continue;
+        }
+        const Weight weight = in_edge.weight + out_edge.weight;
+        if (witness_.reached[out_edge.to] &&
+            !(weight < witness_.weights[out_edge.to])) {
+          continue;
+        }
+        shortcuts.push_back(
+            {in_edge.from, out_edge.to, weight, in_id, out_id});
+      }
+      witness_.Reset();
+    }
+    return shortcuts;
+  }
+
+  // Дейкстра из source по несжатым вершинам, минуя via.
+  // Останавливается, когда все targets окончательно достигнуты.
+  void WitnessSearch(VertexId source, VertexId via, Weight limit,
+                     const std::vector<VertexId>& targets) {
+    witness_.Prepare(contracted_.size());
+    if (is_target_.size() < contracted_.size()) {
+      is_target_.resize(contracted_.size(), false);
+    }
+    for (VertexId target : targets) {
+      is_target_[target] = true;
+    }
+    size_t targets_left = targets.size();
+
+    witness_.Relax(source, Weight{}, NONE);
+    const auto heap_cmp = std::greater<std::pair<Weight, VertexId>>{};
+    size_t settled = 0;
+    while (!witness_.heap.empty() && settled < WITNESS_SETTLE_LIMIT &&
+           targets_left > 0) {
+      std::pop_heap(witness_.heap.begin(), witness_.heap.end(), heap_cmp);
+      const auto [weight, vertex] = witness_.heap.back();
+      witness_.heap.pop_back();
+      if (witness_.weights[vertex] < weight) {
+        continue;
+      }
+      if (limit < weight) {
+        break;
+      }
+      ++settled;
+      if (is_target_[vertex]) {
+        --targets_left;
+      }
+      for (EdgeId id : out_[vertex]) {
+        const ChEdge& edge = edges_[id];
+        if (edge.to == via || contracted_[edge.to]) {
+          continue;
+        }
+        witness_.Relax(edge.to, weight + edge.weight, id);
+      }
+    }
+    witness_.heap.clear();
+    for (VertexId target : targets) {
+      is_target_[target] = false;
+    }
+  }
+
+  std::vector<ChEdge>& edges_;
+  std::vector<std::vector<EdgeId>> out_;
+  std::vector<std::vector<EdgeId>> in_;
+  std::vector<char> contracted_;
+  std::vector<long> deleted_neighbours_;
+  std::vector<size_t> rank_;
+  SearchSpace witness_;
+  std::vector<char> is_target_;
+  std::vector<Shortcut> pending_;
+  size_t last_degree_ = 0;
+};
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph)
+    : graph_(graph) {
+  const size_t vertex_count = graph.GetVertexCount();
+  const std::vector<size_t> rank = Builder(graph, edges_).Contract();
+
+  std::vector<size_t> up_count(vertex_count + 1, 0);
+  std::vector<size_t> down_count(vertex_count + 1, 0);
+  for (const ChEdge& edge : edges_) {
+    shortcut_count_ += edge.original == NONE;
+    if (rank[edge.from] <= rank[edge.to]) {
+      ++up_count[edge.from + 1];
+    }
+    if (rank[edge.from] >= rank[edge.to]) {
+      ++down_count[edge.to + 1];
+    }
+  }
+  for (size_t i = 0; i < vertex_count; ++i) {
+    up_count[i + 1] += up_count[i];
+    down_count[i + 1] += down_count[i];
+  }
+  up_.offsets = up_count;
+  down_.offsets = down_count;
+  up_.arcs.resize(up_count.back());
+  down_.arcs.resize(down_count.back());
+  for (EdgeId id = 0; id < edges_.size(); ++id) {
+    const ChEdge& edge = edges_[id];
+    if (rank[edge.from] <= rank[edge.to]) {
+      up_.arcs[up_count[edge.from]++] = id;
+    }
+    if (rank[edge.from] >= rank[edge.to]) {
+      down_.arcs[down_count[edge.to]++] = id;
+    }
+  }
+}
+
+template <typename Weight>
+size_t ContractionHierarchy<Weight>::GetMemoryUsage() const {
+  return edges_.capacity() * sizeof(ChEdge) +
+         (up_.offsets.capacity() + down_.offsets.capacity()) * sizeof(size_t) +
+         (up_.arcs.capacity() + down_.arcs.capacity()) * sizeof(EdgeId);
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::Unpack(EdgeId edge,
+                                          std::vector<EdgeId>& out) const {
+  std::vector<EdgeId> stack{edge};
+  while (!stack.empty()) {
+    const ChEdge& current = edges_[stack.back()];
+    stack.pop_back();
+    if (current.original != NONE) {
+      out.push_back(current.original);
+    } else {
+      stack.push_back(current.second);
+      stack.push_back(current.first);
+    }
+  }
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::RouteInfo>
+ContractionHierarchy<Weight>::BuildRoute(VertexId from, VertexId to) const {
+  if (from == to) {
+    return RouteInfo{Weight{}, {}};
+  }
+  auto& [forward, backward] = GetWorkspace();
+  forward.Prepare(graph_.GetVertexCount());
+  backward.Prepare(graph_.GetVertexCount());
+  forward.Relax(from, Weight{}, NONE);
+  backward.Relax(to, Weight{}, NONE);
+
+  const auto heap_cmp = std::greater<std::pair<Weight, VertexId>>{};
+  std::optional<Weight> best;
+  VertexId meeting = 0;
+
+  auto step = [&](SearchSpace& space, const SearchSpace& other,
+                  const Adjacency& adjacency, bool is_forward) {
+    std::pop_heap(space.heap.begin(), space.heap.end(), heap_cmp);
+    const auto [weight, vertex] = space.heap.back();
+    space.heap.pop_back();
+    if (space.weights[vertex] < weight) {
+      return;
+    }
+    if (other.reached[vertex]) {
+      const Weight total = weight + other.weights[vertex];
+      if (!best || total < *best) {
+        best = total;
+        meeting = vertex;
+      }
+    }
+    for (EdgeId id : adjacency.Get(vertex)) {
+      const ChEdge& edge = edges_[id];
+      space.Relax(is_forward ? edge.to : edge.from, weight + edge.weight, id);
+    }
+  };
+
+  auto active = [&](const SearchSpace& space) {
+    return !space.heap.empty() && (!best || space.heap.front().first < *best);
+  };
+
+  while (active(forward) || active(backward)) {
+    if (active(forward)) {
+      step(forward, backward, up_, true);
+    }
+    if (active(backward)) {
+      step(backward, forward, down_, false);
+    }
+  }
+
+  std::optional<RouteInfo> result;
+  if (best) {
+    RouteInfo info{*best, {}};
+    std::vector<EdgeId> ch_path;
+    for (EdgeId id = forward.prev_edges[meeting]; id != NONE;
+         id = forward.prev_edges[edges_[id].from]) {
+      ch_path.push_back(id);
+    }
+    std::reverse(ch_path.begin(), ch_path.end());
+    for (EdgeId id = backward.prev_edges[meeting]; id != NONE;
+         id = backward.prev_edges[edges_[id].to]) {
+      ch_path.push_back(id);
+    }
+    for (EdgeId id : ch_path) {
+      Unpack(id, info.edges);
+    }
+    result = std::move(info);
+  }
+  forward.Reset();
+  backward.Reset();
+  return result;
+}
+
+}  // namespace graph
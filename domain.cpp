@@ -2,6 +2,7 @@
 
 
  std::tuple<double, double> Stop::AsTuple() const {
-   return std::make_tuple(coordinates_.lat, coordinates_.lng);
+   const auto coordinates = GetCoordinates();
+   return std::make_tuple(coordinates.lat, coordinates.lng);
  }
 
@@ -3,13 +3,19 @@
 #include <deque>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include "geo.h"
 
 struct Stop {
   std::string name_;
-  transpot_guide::detail::Coordinates
+  transpot_guide::detail::StoredCoordinates
       coordinates_;  /// достаточно относительные пространство имен использовать
+  size_t id_ = 0;  // порядковый номер остановки в каталоге
+
+  transpot_guide::detail::Coordinates GetCoordinates() const {
+    return transpot_guide::detail::FromStored(coordinates_);
+  }
 
   std::tuple<double, double> AsTuple() const;
 
@@ -25,6 +31,13 @@ struct PairStopHash {
   std::hash<const void*> hasher_;
 };
 
+struct StopBusHash {
+  size_t operator()(std::pair<const Stop*, const void*> other) const {
+    return hasher_(other.first) + 1000 * hasher_(other.second);
+  }
+  std::hash<const void*> hasher_;
+};
+
 struct Bus {
   std::string name_;
   std::deque<Stop*> route_stops_;
@@ -33,5 +46,11 @@ struct Bus {
   double lengh = 0;
   double curvature = 1;
   bool is_roundtrip = false;
+  size_t id_ = 0;  // порядковый номер автобуса в каталоге
+  // Дорожная и географическая длина от начала рейса до i-й остановки рейса.
+  // Для некольцевого автобуса рейс включает обратный путь, всего
+  // stops_on_route элементов.
+  std::vector<double> road_prefix_;
+  std::vector<double> geo_prefix_;
   bool operator==(const Bus other) const { return this->name_ == other.name_; }
 };
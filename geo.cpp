@@ -1,16 +1,67 @@
 #include "geo.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace transpot_guide {
 namespace detail {
+namespace {
+const double dr = DEGREE_TO_RADIAN;
+const double earth_radius = 6371000;
+}  // namespace
+
+QuantizedCoordinates Quantize(Coordinates coordinates) {
+  return {static_cast<int32_t>(std::lround(coordinates.lat * QUANTIZATION_SCALE)),
+          static_cast<int32_t>(std::lround(coordinates.lng * QUANTIZATION_SCALE))};
+}
+
+Coordinates Dequantize(QuantizedCoordinates coordinates) {
+  return {coordinates.lat / QUANTIZATION_SCALE,
+          coordinates.lng / QUANTIZATION_SCALE};
+}
+
 double ComputeDistance(Coordinates from, Coordinates to) {
   using namespace std;
-  static const double dr = 3.1415926535 / 180.;
-  return acos(sin(from.lat * dr) * sin(to.lat * dr) +
-              cos(from.lat * dr) * cos(to.lat * dr) *
-                  cos(abs(from.lng - to.lng) * dr)) *
-         6371000;
+  // Для совпадающих точек сумма из-за округления может чуть превысить 1
+  return acos(min(1., sin(from.lat * dr) * sin(to.lat * dr) +
+                          cos(from.lat * dr) * cos(to.lat * dr) *
+                              cos(abs(from.lng - to.lng) * dr))) *
+         earth_radius;
+}
+
+double GetDegreeLength() { return dr * earth_radius; }
+
+double ComputeApproximateDistance(Coordinates from, Coordinates to) {
+  const double x =
+      (to.lng - from.lng) * dr * std::cos((from.lat + to.lat) * 0.5 * dr);
+  const double y = (to.lat - from.lat) * dr;
+  return std::sqrt(x * x + y * y) * earth_radius;
+}
+
+double ComputeDistance(Coordinates from, Coordinates to, DistanceModel model) {
+  if (model == DistanceModel::EQUIRECTANGULAR &&
+      std::abs(from.lat) <= APPROXIMATE_LATITUDE_LIMIT &&
+      std::abs(to.lat) <= APPROXIMATE_LATITUDE_LIMIT) {
+    const double distance = ComputeApproximateDistance(from, to);
+    if (distance <= APPROXIMATE_DISTANCE_LIMIT) {
+      return distance;
+    }
+  }
+  return ComputeDistance(from, to);
+}
+SpherePoint ToSpherePoint(Coordinates coordinates) {
+  const double lat = coordinates.lat * dr;
+  const double lng = coordinates.lng * dr;
+  return {std::cos(lat) * std::cos(lng), std::cos(lat) * std::sin(lng),
+          std::sin(lat)};
 }
+
+double ComputeChordDistance(SpherePoint from, SpherePoint to) {
+  const double dx = from.x - to.x;
+  const double dy = from.y - to.y;
+  const double dz = from.z - to.z;
+  return std::sqrt(dx * dx + dy * dy + dz * dz) * earth_radius;
+}
+
 }  // namespace detail
 }  // namespace transpot_guide
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 
 namespace transpot_guide {
 namespace detail {
@@ -9,7 +10,85 @@ struct Coordinates {
   double lng;
 };
 
+// Координаты в фиксированной точке с шагом 1e-7 градуса (около 1.1 см
+// по широте). Занимают вдвое меньше места, чем Coordinates.
+struct QuantizedCoordinates {
+  int32_t lat;
+  int32_t lng;
+};
+
+inline constexpr double QUANTIZATION_SCALE = 1e7;
+
+QuantizedCoordinates Quantize(Coordinates coordinates);
+
+Coordinates Dequantize(QuantizedCoordinates coordinates);
+
+// Формат хранения координат остановки выбирается при сборке.
+// С TRANSPORT_QUANTIZED_COORDINATES каждая координата округляется до 5e-8
+// градуса, поэтому:
+//  - длина каждого отрезка в ответах Bus отличается не более чем на 2 см
+//    (только для отрезков без заданного дорожного расстояния);
+//  - точки на карте Map смещаются не более чем на 5e-8 * zoom пикселей
+//    (при типичных настройках это меньше 1e-3 px, т.е. ниже точности вывода).
+#ifdef TRANSPORT_QUANTIZED_COORDINATES
+using StoredCoordinates = QuantizedCoordinates;
+#else
+using StoredCoordinates = Coordinates;
+#endif
+
+inline StoredCoordinates ToStored(Coordinates coordinates) {
+#ifdef TRANSPORT_QUANTIZED_COORDINATES
+  return Quantize(coordinates);
+#else
+  return coordinates;
+#endif
+}
+
+inline Coordinates FromStored(StoredCoordinates coordinates) {
+#ifdef TRANSPORT_QUANTIZED_COORDINATES
+  return Dequantize(coordinates);
+#else
+  return coordinates;
+#endif
+}
+
+// Радиан в градусе; общий для всех моделей расстояния
+inline constexpr double DEGREE_TO_RADIAN = 3.1415926535 / 180.;
+
 double ComputeDistance(Coordinates from, Coordinates to);
 
+// Длина дуги меридиана в один градус, м
+double GetDegreeLength();
+
+// Модель расстояния между остановками.
+// EQUIRECTANGULAR считает по плоской проекции с косинусом средней широты.
+// Для отрезков до APPROXIMATE_DISTANCE_LIMIT метров и широт до
+// APPROXIMATE_LATITUDE_LIMIT градусов относительная погрешность
+// не превышает APPROXIMATE_DISTANCE_ERROR. Это проверено по ComputeDistance
+// для отрезков от 50 м; на более коротких отрезках сам закон косинусов
+// теряет точность. Остальные отрезки считаются точной формулой.
+enum class DistanceModel { EXACT, EQUIRECTANGULAR };
+
+inline constexpr double APPROXIMATE_DISTANCE_LIMIT = 20000;
+inline constexpr double APPROXIMATE_LATITUDE_LIMIT = 75;
+inline constexpr double APPROXIMATE_DISTANCE_ERROR = 1e-5;
+
+double ComputeApproximateDistance(Coordinates from, Coordinates to);
+
+double ComputeDistance(Coordinates from, Coordinates to, DistanceModel model);
+
+// Точка на единичной сфере. Хорда между такими точками (в метрах) не длиннее
+// дуги ComputeDistance и считается без тригонометрии, поэтому годится как
+// дешёвая нижняя оценка расстояния.
+struct SpherePoint {
+  double x;
+  double y;
+  double z;
+};
+
+SpherePoint ToSpherePoint(Coordinates coordinates);
+
+double ComputeChordDistance(SpherePoint from, SpherePoint to);
+
 }  // namespace detail
 }  // namespace transpot_guide
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdlib>
+#include <vector>
+
+namespace graph {
+
+using VertexId = size_t;
+using EdgeId = size_t;
+
+template <typename Weight>
+struct Edge {
+  VertexId from;
+  VertexId to;
+  Weight weight;
+};
+
+template <typename Iterator>
+class Range {
+ public:
+  Range(Iterator begin, Iterator end) : begin_(begin), end_(end) {}
+
+  Iterator begin() const { return begin_; }
+  Iterator end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+
+ private:
+  Iterator begin_;
+  Iterator end_;
+};
+
+template <typename Weight>
+class DirectedWeightedGraph {
+ private:
+  using IncidenceList = std::vector<EdgeId>;
+  using IncidentEdgesRange = Range<typename IncidenceList::const_iterator>;
+
+ public:
+  DirectedWeightedGraph() = default;
+  explicit DirectedWeightedGraph(size_t vertex_count)
+      : incidence_lists_(vertex_count) {}
+
+  EdgeId AddEdge(const Edge<Weight>& edge) {
+    edges_.push_back(edge);
+    const EdgeId id = edges_.size() - 1;
+    incidence_lists_.at(edge.from).push_back(id);
+    return id;
+  }
+
+  size_t GetVertexCount() const { return incidence_lists_.size(); }
+
+  size_t GetEdgeCount() const { return edges_.size(); }
+
+  const Edge<Weight>& GetEdge(EdgeId edge_id) const {
+    return edges_.at(edge_id);
+  }
+
+  IncidentEdgesRange GetIncidentEdges(VertexId vertex) const {
+    const auto& edges = incidence_lists_.at(vertex);
+    return {edges.begin(), edges.end()};
+  }
+
+ private:
+  std::vector<Edge<Weight>> edges_;
+  std::vector<IncidenceList> incidence_lists_;
+};
+
+}  // namespace graph
@@ -0,0 +1,656 @@
+#include "gzip.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace gzip {
+
+namespace {
+
+constexpr size_t MIN_MATCH = 3;
+constexpr size_t MAX_MATCH = 258;
+// Повтор из трёх байт дальше этого обходится дороже литералов
+constexpr size_t TOO_FAR = 4096;
+
+constexpr int MAX_BITS = 15;
+constexpr int MAX_CODE_LENGTH_BITS = 7;
+constexpr size_t LITERAL_CODES = 286;
+constexpr size_t DISTANCE_CODES = 30;
+constexpr size_t CODE_LENGTH_CODES = 19;
+constexpr uint16_t END_OF_BLOCK = 256;
+constexpr size_t MAX_STORED = 65535;
+
+// Порядок длин кодов длин в заголовке динамического блока
+constexpr uint8_t CODE_LENGTH_ORDER[CODE_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr uint16_t LENGTH_BASE[] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                    11, 13, 15, 17,  19,  23,  27,  31,
+                                    35, 43, 51, 59,  67,  83,  99,  115,
+                                    131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                    1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                    4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DISTANCE_BASE[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t DISTANCE_EXTRA[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
+                                      4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+                                      9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Параметры поиска повторов по уровням, как в zlib. На уровнях 1-3
+// поиск жадный, и в хеш идут только начала длинных повторов. На
+// остальных после повтора не короче good_length цепочка смотрится
+// вчетверо короче.
+struct LevelParams {
+  size_t max_chain;
+  size_t nice_length;
+  size_t lazy_length;
+  size_t good_length;
+  size_t max_insert;
+};
+
+constexpr LevelParams LEVEL_PARAMS[] = {
+    {0, 0, 0, 0, 0},          {4, 8, 0, 0, 4},        {8, 16, 0, 0, 5},
+    {32, 32, 0, 0, 6},        {16, 16, 4, 4, 0},      {32, 32, 16, 8, 0},
+    {128, 128, 16, 8, 0},     {256, 128, 32, 8, 0},   {1024, 258, 128, 32, 0},
+    {4096, 258, 258, 32, 0}};
+
+// Длина общего начала строк не больше limit, первые from байт совпадают.
+// Сравнение идёт по 8 байт.
+size_t GetCommonLength(const char* left, const char* right, size_t from,
+                       size_t limit) {
+  size_t length = from;
+  while (length + sizeof(uint64_t) <= limit) {
+    uint64_t left_word;
+    uint64_t right_word;
+    std::memcpy(&left_word, left + length, sizeof(left_word));
+    std::memcpy(&right_word, right + length, sizeof(right_word));
+    if (left_word != right_word) {
+      break;
+    }
+    length += sizeof(uint64_t);
+  }
+  while (length < limit && left[length] == right[length]) {
+    ++length;
+  }
+  return length;
+}
+
+// Номера кодов длин и расстояний повторов
+struct CodeTables {
+  CodeTables() : distance_codes(1 << 15) {
+    for (uint8_t code = 0; code < std::size(LENGTH_BASE); ++code) {
+      for (size_t i = 0; i < (size_t{1} << LENGTH_EXTRA[code]); ++i) {
+        const size_t length = LENGTH_BASE[code] + i;
+        if (length <= MAX_MATCH) {
+          length_codes[length - MIN_MATCH] = code;
+        }
+      }
+    }
+    for (uint8_t code = 0; code < std::size(DISTANCE_BASE); ++code) {
+      for (size_t i = 0; i < (size_t{1} << DISTANCE_EXTRA[code]); ++i) {
+        distance_codes[DISTANCE_BASE[code] - 1 + i] = code;
+      }
+    }
+  }
+
+  std::array<uint8_t, MAX_MATCH - MIN_MATCH + 1> length_codes{};
+  std::vector<uint8_t> distance_codes;  // по расстоянию - 1
+};
+
+const CodeTables& GetCodeTables() {
+  static const CodeTables tables;
+  return tables;
+}
+
+// Длины кодов Хаффмана не больше max_bits. Если дерево получается
+// глубже, частоты огрубляются вдвое, пока оно не поместится.
+std::vector<uint8_t> BuildCodeLengths(std::vector<uint32_t> freqs,
+                                      int max_bits) {
+  const size_t count = freqs.size();
+  // Код из одного символа неполный, поэтому используются хотя бы два
+  size_t used = std::count_if(freqs.begin(), freqs.end(),
+                              [](uint32_t freq) { return freq > 0; });
+  for (size_t i = 0; used < 2 && i < count; ++i) {
+    if (freqs[i] == 0) {
+      freqs[i] = 1;
+      ++used;
+    }
+  }
+
+  std::vector<uint8_t> lengths(count, 0);
+  while (true) {
+    using Item = std::pair<uint64_t, uint32_t>;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (freqs[i] > 0) {
+        heap.push({freqs[i], i});
+      }
+    }
+    // Листья — символы, внутренние узлы нумеруются после них,
+    // поэтому родитель всегда старше потомков
+    std::vector<uint32_t> parents(2 * count);
+    uint32_t next = count;
+    while (heap.size() > 1) {
+      const Item left = heap.top();
+      heap.pop();
+      const Item right = heap.top();
+      heap.pop();
+      parents[left.second] = next;
+      parents[right.second] = next;
+      heap.push({left.first + right.first, next++});
+    }
+    std::vector<int> depths(next, 0);
+    int max_depth = 0;
+    for (uint32_t node = next - 1; node-- > 0;) {
+      if (node < count && freqs[node] == 0) {
+        continue;
+      }
+      depths[node] = depths[parents[node]] + 1;
+      if (node < count) {
+        lengths[node] = static_cast<uint8_t>(depths[node]);
+        max_depth = std::max(max_depth, depths[node]);
+      }
+    }
+    if (max_depth <= max_bits) {
+      return lengths;
+    }
+    for (uint32_t& freq : freqs) {
+      if (freq > 0) {
+        freq = (freq >> 1) | 1;
+      }
+    }
+  }
+}
+
+// Канонические коды по длинам, биты развёрнуты: deflate пишет коды
+// Хаффмана начиная со старшего бита
+std::vector<uint16_t> BuildCodes(const std::vector<uint8_t>& lengths) {
+  uint16_t counts[MAX_BITS + 1] = {};
+  for (uint8_t length : lengths) {
+    ++counts[length];
+  }
+  counts[0] = 0;
+  uint16_t next_codes[MAX_BITS + 1] = {};
+  uint32_t code = 0;
+  for (int bits = 1; bits <= MAX_BITS; ++bits) {
+    code = (code + counts[bits - 1]) << 1;
+    next_codes[bits] = static_cast<uint16_t>(code);
+  }
+
+  std::vector<uint16_t> codes(lengths.size(), 0);
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    if (lengths[i] == 0) {
+      continue;
+    }
+    uint32_t value = next_codes[lengths[i]]++;
+    uint16_t reversed = 0;
+    for (int bit = 0; bit < lengths[i]; ++bit) {
+      reversed = static_cast<uint16_t>((reversed << 1) | (value & 1));
+      value >>= 1;
+    }
+    codes[i] = reversed;
+  }
+  return codes;
+}
+
+// Длины кодов в заголовке блока, сжатые повторами: 16 — повтор
+// предыдущей длины 3-6 раз, 17 — 3-10 нулей, 18 — 11-138 нулей
+struct CodeLengthSymbol {
+  uint8_t symbol;
+  uint8_t extra;
+};
+
+constexpr uint8_t CODE_LENGTH_EXTRA_BITS[] = {2, 3, 7};
+
+std::vector<CodeLengthSymbol> EncodeCodeLengths(
+    const std::vector<uint8_t>& lengths) {
+  std::vector<CodeLengthSymbol> symbols;
+  size_t i = 0;
+  while (i < lengths.size()) {
+    const uint8_t value = lengths[i];
+    size_t run = 1;
+    while (i + run < lengths.size() && lengths[i + run] == value) {
+      ++run;
+    }
+    i += run;
+    if (value == 0) {
+      while (run >= 11) {
+        const size_t part = std::min<size_t>(run, 138);
+        symbols.push_back({18, static_cast<uint8_t>(part - 11)});
+        run -= part;
+      }
+      if (run >= 3) {
+        symbols.push_back({17, static_cast<uint8_t>(run - 3)});
+        run = 0;
+      }
+    } else {
+      symbols.push_back({value, 0});
+      --run;
+      while (run >= 3) {
+        const size_t part = std::min<size_t>(run, 6);
+        symbols.push_back({16, static_cast<uint8_t>(part - 3)});
+        run -= part;
+      }
+    }
+    for (; run > 0; --run) {
+      symbols.push_back({value, 0});
+    }
+  }
+  return symbols;
+}
+
+// Таблицы CRC-32 для обработки по 8 байт: tables[k][b] — CRC байта b,
+// за которым идут k нулевых байт
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+const CrcTables& GetCrcTables() {
+  static const CrcTables tables = [] {
+    CrcTables result{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+      }
+      result[0][i] = value;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (size_t k = 1; k < result.size(); ++k) {
+        const uint32_t prev = result[k - 1][i];
+        result[k][i] = result[0][prev & 0xFF] ^ (prev >> 8);
+      }
+    }
+    return result;
+  }();
+  return tables;
+}
+
+}  // namespace
+
+Deflater::Deflater(int level)
+    : level_(std::clamp(level, MIN_LEVEL, MAX_LEVEL)),
+      max_chain_(LEVEL_PARAMS[level_].max_chain),
+      nice_length_(LEVEL_PARAMS[level_].nice_length),
+      lazy_length_(LEVEL_PARAMS[level_].lazy_length),
+      good_length_(LEVEL_PARAMS[level_].good_length),
+      max_insert_(LEVEL_PARAMS[level_].max_insert) {
+  if (level_ > 0) {
+    head_.assign(size_t{1} << HASH_BITS, 0);
+    prev_.assign(WINDOW_SIZE, 0);
+  }
+}
+
+void Deflater::Write(std::string_view data, std::string& out) {
+  while (!data.empty()) {
+    const size_t pending = base_ + data_.size() - pending_;
+    const size_t part = std::min(data.size(), BLOCK_SIZE - pending);
+    data_.append(data.substr(0, part));
+    data.remove_prefix(part);
+    if (pending + part == BLOCK_SIZE) {
+      CompressPending(false, out);
+    }
+  }
+}
+
+void Deflater::Finish(std::string& out) {
+  CompressPending(true, out);
+  AlignToByte(out);
+}
+
+void Deflater::CompressPending(bool last, std::string& out) {
+  const size_t end = base_ + data_.size();
+  if (level_ == 0) {
+    WriteStored(pending_, end, last, out);
+  } else {
+    symbols_.clear();
+    FindSymbols(end);
+    WriteBlock(pending_, end, last, out);
+  }
+  pending_ = end;
+  // В окне остаются последние WINDOW_SIZE байт для поиска повторов
+  if (data_.size() > WINDOW_SIZE) {
+    const size_t drop = data_.size() - WINDOW_SIZE;
+    data_.erase(0, drop);
+    base_ += drop;
+  }
+}
+
+uint32_t Deflater::Hash(size_t pos) const {
+  const auto* bytes =
+      reinterpret_cast<const unsigned char*>(data_.data() + (pos - base_));
+  const uint32_t value = bytes[0] | bytes[1] << 8 | bytes[2] << 16;
+  return (value * 0x9E3779B1u) >> (32 - HASH_BITS);
+}
+
+void Deflater::InsertHash(size_t pos, size_t end) {
+  if (end - pos < MIN_MATCH) {
+    return;
+  }
+  const uint32_t hash = Hash(pos);
+  prev_[pos & (WINDOW_SIZE - 1)] = head_[hash];
+  head_[hash] = pos + 1;
+}
+
+size_t Deflater::FindMatch(size_t pos, size_t end, size_t chain,
+                           size_t& distance) const {
+  const size_t limit = std::min(MAX_MATCH, end - pos);
+  if (limit < MIN_MATCH) {
+    return 0;
+  }
+  const char* current = data_.data() + (pos - base_);
+  const size_t min_pos = pos > WINDOW_SIZE ? pos - WINDOW_SIZE : 0;
+  size_t best = MIN_MATCH - 1;
+  for (size_t candidate = head_[Hash(pos)]; candidate > min_pos && chain > 0;
+       candidate = prev_[(candidate - 1) & (WINDOW_SIZE - 1)], --chain) {
+    const char* match = data_.data() + (candidate - 1 - base_);
+    if (match[best] != current[best] || match[0] != current[0] ||
+        match[1] != current[1]) {
+      continue;
+    }
+    const size_t length = GetCommonLength(current, match, 2, limit);
+    if (length > best) {
+      best = length;
+      distance = pos - (candidate - 1);
+      if (length >= nice_length_ || length == limit) {
+        break;
+      }
+    }
+  }
+  if (best < MIN_MATCH || (best == MIN_MATCH && distance > TOO_FAR)) {
+    return 0;
+  }
+  return best;
+}
+
+void Deflater::FindSymbols(size_t end) {
+  auto literal = [this](size_t pos) {
+    symbols_.push_back(
+        {static_cast<unsigned char>(data_[pos - base_]), 0});
+  };
+  auto match = [this](size_t length, size_t distance) {
+    symbols_.push_back(
+        {static_cast<uint16_t>(length), static_cast<uint16_t>(distance)});
+  };
+
+  size_t pos = pending_;
+  if (lazy_length_ == 0) {
+    while (pos < end) {
+      size_t distance = 0;
+      const size_t length = FindMatch(pos, end, max_chain_, distance);
+      if (length < MIN_MATCH) {
+        literal(pos);
+        InsertHash(pos++, end);
+        continue;
+      }
+      match(length, distance);
+      if (length > max_insert_) {
+        InsertHash(pos, end);
+        pos += length;
+        continue;
+      }
+      for (const size_t match_end = pos + length; pos < match_end; ++pos) {
+        InsertHash(pos, end);
+      }
+    }
+    return;
+  }
+
+  // Отложенный выбор: повтор с pos - 1 берётся, только если с pos
+  // не начинается более длинный
+  bool has_prev = false;
+  size_t prev_length = 0;
+  size_t prev_distance = 0;
+  while (pos < end) {
+    size_t length = 0;
+    size_t distance = 0;
+    if (!has_prev || prev_length < lazy_length_) {
+      const size_t chain =
+          has_prev && prev_length >= good_length_ ? max_chain_ / 4 : max_chain_;
+      length = FindMatch(pos, end, chain, distance);
+    }
+    InsertHash(pos, end);
+    if (has_prev && prev_length >= MIN_MATCH && length <= prev_length) {
+      match(prev_length, prev_distance);
+      const size_t match_end = pos - 1 + prev_length;
+      for (++pos; pos < match_end; ++pos) {
+        InsertHash(pos, end);
+      }
+      has_prev = false;
+      continue;
+    }
+    if (has_prev) {
+      literal(pos - 1);
+    }
+    has_prev = true;
+    prev_length = length;
+    prev_distance = distance;
+    ++pos;
+  }
+  if (has_prev) {
+    literal(pos - 1);
+  }
+}
+
+void Deflater::WriteBlock(size_t from, size_t to, bool last,
+                          std::string& out) {
+  const CodeTables& tables = GetCodeTables();
+  std::vector<uint32_t> literal_freqs(LITERAL_CODES, 0);
+  std::vector<uint32_t> distance_freqs(DISTANCE_CODES, 0);
+  for (const Symbol& symbol : symbols_) {
+    if (symbol.distance == 0) {
+      ++literal_freqs[symbol.value];
+    } else {
+      ++literal_freqs[257 + tables.length_codes[symbol.value - MIN_MATCH]];
+      ++distance_freqs[tables.distance_codes[symbol.distance - 1]];
+    }
+  }
+  literal_freqs[END_OF_BLOCK] = 1;
+
+  const std::vector<uint8_t> literal_lengths =
+      BuildCodeLengths(literal_freqs, MAX_BITS);
+  const std::vector<uint8_t> distance_lengths =
+      BuildCodeLengths(distance_freqs, MAX_BITS);
+  size_t literal_count = LITERAL_CODES;
+  while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) {
+    --literal_count;
+  }
+  size_t distance_count = DISTANCE_CODES;
+  while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+    --distance_count;
+  }
+
+  std::vector<uint8_t> all_lengths(literal_lengths.begin(),
+                                   literal_lengths.begin() + literal_count);
+  all_lengths.insert(all_lengths.end(), distance_lengths.begin(),
+                     distance_lengths.begin() + distance_count);
+  const std::vector<CodeLengthSymbol> header = EncodeCodeLengths(all_lengths);
+  std::vector<uint32_t> header_freqs(CODE_LENGTH_CODES, 0);
+  for (const CodeLengthSymbol& symbol : header) {
+    ++header_freqs[symbol.symbol];
+  }
+  const std::vector<uint8_t> header_lengths =
+      BuildCodeLengths(header_freqs, MAX_CODE_LENGTH_BITS);
+  size_t header_count = CODE_LENGTH_CODES;
+  while (header_count > 4 &&
+         header_lengths[CODE_LENGTH_ORDER[header_count - 1]] == 0) {
+    --header_count;
+  }
+
+  // Длина блока в битах — чтобы выбрать между сжатым и несжатым
+  size_t bits = 3 + 5 + 5 + 4 + 3 * header_count;
+  for (const CodeLengthSymbol& symbol : header) {
+    bits += header_lengths[symbol.symbol];
+    if (symbol.symbol >= 16) {
+      bits += CODE_LENGTH_EXTRA_BITS[symbol.symbol - 16];
+    }
+  }
+  for (size_t i = 0; i < LITERAL_CODES; ++i) {
+    bits += size_t{literal_freqs[i]} * literal_lengths[i];
+  }
+  for (size_t i = 0; i < DISTANCE_CODES; ++i) {
+    bits += size_t{distance_freqs[i]} *
+            (distance_lengths[i] + DISTANCE_EXTRA[i]);
+  }
+  for (size_t i = 0; i < std::size(LENGTH_EXTRA); ++i) {
+    bits += size_t{literal_freqs[257 + i]} * LENGTH_EXTRA[i];
+  }
+  const size_t stored_chunks = std::max<size_t>(1, (to - from + MAX_STORED - 1) / MAX_STORED);
+  const size_t stored_bits = (to - from + 5 * stored_chunks) * 8 + 7;
+  if (stored_bits <= bits) {
+    WriteStored(from, to, last, out);
+    return;
+  }
+
+  const std::vector<uint16_t> literal_codes = BuildCodes(literal_lengths);
+  const std::vector<uint16_t> distance_codes = BuildCodes(distance_lengths);
+  const std::vector<uint16_t> header_codes = BuildCodes(header_lengths);
+  PutBits(last ? 1 : 0, 1, out);
+  PutBits(2, 2, out);
+  PutBits(literal_count - 257, 5, out);
+  PutBits(distance_count - 1, 5, out);
+  PutBits(header_count - 4, 4, out);
+  for (size_t i = 0; i < header_count; ++i) {
+    PutBits(header_lengths[CODE_LENGTH_ORDER[i]], 3, out);
+  }
+  for (const CodeLengthSymbol& symbol : header) {
+    PutBits(header_codes[symbol.symbol], header_lengths[symbol.symbol], out);
+    if (symbol.symbol >= 16) {
+      PutBits(symbol.extra, CODE_LENGTH_EXTRA_BITS[symbol.symbol - 16], out);
+    }
+  }
+  for (const Symbol& symbol : symbols_) {
+    if (symbol.distance == 0) {
+      PutBits(literal_codes[symbol.value], literal_lengths[symbol.value], out);
+      continue;
+    }
+    const uint8_t length_code = tables.length_codes[symbol.value - MIN_MATCH];
+    PutBits(literal_codes[257 + length_code],
+            literal_lengths[257 + length_code], out);
+    PutBits(symbol.value - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code],
+            out);
+    const uint8_t distance_code = tables.distance_codes[symbol.distance - 1];
+    PutBits(distance_codes[distance_code], distance_lengths[distance_code],
+            out);
+    PutBits(symbol.distance - DISTANCE_BASE[distance_code],
+            DISTANCE_EXTRA[distance_code], out);
+  }
+  PutBits(literal_codes[END_OF_BLOCK], literal_lengths[END_OF_BLOCK], out);
+}
+
+void Deflater::WriteStored(size_t from, size_t to, bool last,
+                           std::string& out) {
+  // Пустой последний блок тоже пишется: им закрывается поток
+  do {
+    const size_t length = std::min(to - from, MAX_STORED);
+    PutBits(last && from + length == to ? 1 : 0, 1, out);
+    PutBits(0, 2, out);
+    AlignToByte(out);
+    out.push_back(static_cast<char>(length & 0xFF));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(~length & 0xFF));
+    out.push_back(static_cast<char>((~length >> 8) & 0xFF));
+    out.append(data_, from - base_, length);
+    from += length;
+  } while (from < to);
+}
+
+void Deflater::PutBits(uint32_t value, int count, std::string& out) {
+  bit_buffer_ |= static_cast<uint64_t>(value) << bit_count_;
+  bit_count_ += count;
+  if (bit_count_ >= 32) {
+    const uint32_t word = static_cast<uint32_t>(bit_buffer_);
+    const char bytes[] = {static_cast<char>(word), static_cast<char>(word >> 8),
+                          static_cast<char>(word >> 16),
+                          static_cast<char>(word >> 24)};
+    out.append(bytes, 4);
+    bit_buffer_ >>= 32;
+    bit_count_ -= 32;
+  }
+}
+
+void Deflater::AlignToByte(std::string& out) {
+  while (bit_count_ > 0) {
+    out.push_back(static_cast<char>(bit_buffer_));
+    bit_buffer_ >>= 8;
+    bit_count_ = std::max(bit_count_ - 8, 0);
+  }
+  bit_buffer_ = 0;
+}
+
+uint32_t UpdateCrc32(uint32_t crc, std::string_view data) {
+  const CrcTables& tables = GetCrcTables();
+  const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+  size_t size = data.size();
+  crc = ~crc;
+  for (; size >= 8; bytes += 8, size -= 8) {
+    const uint32_t low =
+        crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+               static_cast<uint32_t>(bytes[3]) << 24);
+    crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^
+          tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+          tables[3][bytes[4]] ^ tables[2][bytes[5]] ^ tables[1][bytes[6]] ^
+          tables[0][bytes[7]];
+  }
+  for (; size > 0; ++bytes, --size) {
+    crc = tables[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+GzipBuffer::GzipBuffer(std::ostream& output, int level)
+    : output_(output), deflater_(level) {
+  // Сигнатура, метод deflate, без флагов и времени, ОС не указана
+  const char header[] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+  output_.write(header, sizeof(header));
+}
+
+GzipBuffer::~GzipBuffer() { Finish(); }
+
+void GzipBuffer::Finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  deflater_.Finish(compressed_);
+  for (uint32_t value : {crc_, size_}) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      compressed_.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+  }
+  FlushCompressed();
+}
+
+void GzipBuffer::Write(std::string_view value) {
+  crc_ = UpdateCrc32(crc_, value);
+  size_ += static_cast<uint32_t>(value.size());
+  deflater_.Write(value, compressed_);
+  if (compressed_.size() >= (1 << 16)) {
+    FlushCompressed();
+  }
+}
+
+void GzipBuffer::FlushCompressed() {
+  output_.write(compressed_.data(), compressed_.size());
+  compressed_.clear();
+}
+
+GzipBuffer::int_type GzipBuffer::overflow(int_type c) {
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    const char ch = traits_type::to_char_type(c);
+    Write({&ch, 1});
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize GzipBuffer::xsputn(const char* s, std::streamsize n) {
+  Write({s, static_cast<size_t>(n)});
+  return n;
+}
+
+}  // namespace gzip
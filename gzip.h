@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gzip {
+
+// Уровни сжатия как у zlib: 0 — без сжатия, 1 — быстрее, 9 — сильнее
+constexpr int MIN_LEVEL = 0;
+constexpr int MAX_LEVEL = 9;
+constexpr int DEFAULT_LEVEL = 6;
+
+// Сжатие deflate (RFC 1951). Повторы ищутся по цепочкам хешей в окне
+// 32 КБ, каждые BLOCK_SIZE входных байт — блок с динамическими кодами
+// Хаффмана или, если так короче, несжатый блок. Данные подаются частями,
+// сжатые байты дописываются в конец out.
+class Deflater {
+ public:
+  explicit Deflater(int level = DEFAULT_LEVEL);
+
+  void Write(std::string_view data, std::string& out);
+
+  // Сжимает остаток последним блоком. После него Write не вызывается.
+  void Finish(std::string& out);
+
+ private:
+  static constexpr size_t WINDOW_SIZE = 1 << 15;
+  static constexpr size_t BLOCK_SIZE = 1 << 17;
+  static constexpr int HASH_BITS = 15;
+
+  // Повтор длины length на расстоянии distance или литерал (distance 0)
+  struct Symbol {
+    uint16_t value;
+    uint16_t distance;
+  };
+
+  void CompressPending(bool last, std::string& out);
+  void FindSymbols(size_t end);
+  size_t FindMatch(size_t pos, size_t end, size_t chain,
+                   size_t& distance) const;
+  void InsertHash(size_t pos, size_t end);
+  uint32_t Hash(size_t pos) const;
+
+  void WriteBlock(size_t from, size_t to, bool last, std::string& out);
+  void WriteStored(size_t from, size_t to, bool last, std::string& out);
+  void PutBits(uint32_t value, int count, std::string& out);
+  void AlignToByte(std::string& out);
+
+  int level_;
+  size_t max_chain_;  // сколько кандидатов смотреть в цепочке
+  size_t nice_length_;  // повтор такой длины берётся сразу
+  size_t lazy_length_;  // 0 — жадный поиск без отложенного выбора
+  size_t good_length_;  // после такого повтора цепочка смотрится короче
+  size_t max_insert_;  // у более длинных повторов в хеш идёт только начало
+
+  std::string data_;  // окно и ещё не сжатые байты
+  size_t base_ = 0;  // позиция data_[0] от начала потока
+  size_t pending_ = 0;  // позиция первого несжатого байта
+  // Позиция + 1 последнего байта с таким хешем и предыдущего в цепочке
+  std::vector<size_t> head_;
+  std::vector<size_t> prev_;
+  std::vector<Symbol> symbols_;
+
+  uint64_t bit_buffer_ = 0;
+  int bit_count_ = 0;
+};
+
+uint32_t UpdateCrc32(uint32_t crc, std::string_view data);
+
+// Буфер потока, который сжимает всё записанное в формат gzip (RFC 1952)
+// и передаёт в output. Поток закрывается Finish или деструктором.
+//   gzip::GzipBuffer buffer(file, 6);
+//   std::ostream compressed(&buffer);
+//   document.Render(compressed);
+class GzipBuffer : public std::streambuf {
+ public:
+  explicit GzipBuffer(std::ostream& output, int level = DEFAULT_LEVEL);
+
+  GzipBuffer(const GzipBuffer&) = delete;
+  GzipBuffer& operator=(const GzipBuffer&) = delete;
+
+  ~GzipBuffer() override;
+
+  void Finish();
+
+ protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+  void Write(std::string_view value);
+  void FlushCompressed();
+
+  std::ostream& output_;
+  Deflater deflater_;
+  std::string compressed_;
+  uint32_t crc_ = 0;
+  uint32_t size_ = 0;  // длина входа по модулю 2^32
+  bool finished_ = false;
+};
+
+}  // namespace gzip
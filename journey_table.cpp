@@ -0,0 +1,234 @@
+#include "journey_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string_view>
+
+#include "gzip.h"
+
+namespace transpot_guide {
+namespace {
+const char MAGIC[4] = {'T', 'C', 'J', 'T'};
+const uint32_t VERSION = 2;
+
+template <typename T>
+void WriteValue(std::ostream& output, const T& value) {
+  output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadValue(std::istream& input, T& value) {
+  return static_cast<bool>(
+      input.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+}  // namespace
+
+std::optional<JourneyTable> JourneyTable::Build(
+    const graph::Router<double>& router, size_t stop_count, ThreadPool& pool) {
+  const auto& graph = router.GetGraph();
+  if (graph.GetVertexCount() >= UNREACHABLE) {
+    throw std::length_error("Graph is too large for a journey table");
+  }
+  if (stop_count > MAX_STOP_COUNT) {
+    return std::nullopt;
+  }
+  JourneyTable table;
+  table.stop_count_ = stop_count;
+  table.boards_.assign(stop_count * stop_count, UNREACHABLE);
+  table.spans_.assign(stop_count * stop_count, 0);
+  table.position_stops_ = GetPositionStops(graph, stop_count);
+
+  std::atomic<bool> too_long = false;
+  pool.ParallelFor(0, stop_count, [&](size_t from) {
+    thread_local std::vector<graph::EdgeId> prev_edges;
+    thread_local std::vector<graph::VertexId> settled;
+    prev_edges.resize(graph.GetVertexCount(), graph::Router<double>::NONE);
+
+    router.Explore(from, [&](graph::VertexId vertex, double,
+                             graph::EdgeId prev_edge) {
+      prev_edges[vertex] = prev_edge;
+      settled.push_back(vertex);
+    });
+
+    for (graph::VertexId to : settled) {
+      if (to >= stop_count || to == from) {
+        continue;
+      }
+      // Назад от прибытия: высадка, перегоны, посадка
+      graph::VertexId position = graph.GetEdge(prev_edges[to]).from;
+      size_t span_count = 0;
+      while (true) {
+        const auto& edge = graph.GetEdge(prev_edges[position]);
+        if (edge.from < stop_count) {
+          break;
+        }
+        position = edge.from;
+        ++span_count;
+      }
+      if (span_count > MAX_SPAN_COUNT) {
+        too_long = true;
+        continue;
+      }
+      table.boards_[table.Index(from, to)] = static_cast<uint32_t>(position);
+      table.spans_[table.Index(from, to)] = static_cast<uint16_t>(span_count);
+    }
+    table.boards_[table.Index(from, from)] = 0;
+
+    for (graph::VertexId vertex : settled) {
+      prev_edges[vertex] = graph::Router<double>::NONE;
+    }
+    settled.clear();
+  });
+  if (too_long) {
+    return std::nullopt;
+  }
+  return table;
+}
+
+std::optional<JourneyTable> JourneyTable::Load(
+    std::istream& input, uint64_t fingerprint,
+    const graph::DirectedWeightedGraph<double>& graph, size_t stop_count) {
+  const size_t vertex_count = graph.GetVertexCount();
+  char magic[4];
+  uint32_t version = 0;
+  uint64_t file_fingerprint = 0;
+  uint64_t file_stop_count = 0;
+  uint64_t position_count = 0;
+  uint32_t checksum = 0;
+  if (!input.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + 4, MAGIC) || !ReadValue(input, version) ||
+      version != VERSION || !ReadValue(input, file_fingerprint) ||
+      file_fingerprint != fingerprint || !ReadValue(input, file_stop_count) ||
+      !ReadValue(input, position_count) || !ReadValue(input, checksum)) {
+    return std::nullopt;
+  }
+  // Размеры проверяются до выделения памяти: в испорченном файле они
+  // могут быть любыми
+  if (file_stop_count != stop_count || stop_count > MAX_STOP_COUNT ||
+      stop_count > vertex_count ||
+      position_count != vertex_count - stop_count) {
+    return std::nullopt;
+  }
+
+  JourneyTable table;
+  table.stop_count_ = stop_count;
+  table.boards_.resize(stop_count * stop_count);
+  table.spans_.resize(stop_count * stop_count);
+  table.position_stops_.resize(position_count);
+  if (!input.read(reinterpret_cast<char*>(table.position_stops_.data()),
+                  table.position_stops_.size() * sizeof(uint32_t)) ||
+      !input.read(reinterpret_cast<char*>(table.boards_.data()),
+                  table.boards_.size() * sizeof(uint32_t)) ||
+      !input.read(reinterpret_cast<char*>(table.spans_.data()),
+                  table.spans_.size() * sizeof(uint16_t))) {
+    return std::nullopt;
+  }
+  if (table.ComputeChecksum() != checksum ||
+      table.position_stops_ != GetPositionStops(graph, stop_count)) {
+    return std::nullopt;
+  }
+
+  // Сумма не спасает от файла, записанного с ошибкой, поэтому каждая
+  // посадка проверяется по графу: это позиция в автобусе, и поездка от
+  // неё не длиннее остатка рейса
+  const std::vector<uint32_t> ride_lengths = GetRideLengths(graph, stop_count);
+  for (size_t from = 0; from < stop_count; ++from) {
+    for (size_t to = 0; to < stop_count; ++to) {
+      const size_t index = table.Index(from, to);
+      const uint32_t board = table.boards_[index];
+      if (from == to) {
+        if (board != 0) {
+          return std::nullopt;
+        }
+      } else if (board != UNREACHABLE &&
+                 (board < stop_count || board >= vertex_count ||
+                  table.spans_[index] > ride_lengths[board - stop_count])) {
+        return std::nullopt;
+      }
+    }
+  }
+  return table;
+}
+
+bool JourneyTable::Save(std::ostream& output, uint64_t fingerprint) const {
+  output.write(MAGIC, sizeof(MAGIC));
+  WriteValue(output, VERSION);
+  WriteValue(output, fingerprint);
+  WriteValue(output, static_cast<uint64_t>(stop_count_));
+  WriteValue(output, static_cast<uint64_t>(position_stops_.size()));
+  WriteValue(output, ComputeChecksum());
+  output.write(reinterpret_cast<const char*>(position_stops_.data()),
+               position_stops_.size() * sizeof(uint32_t));
+  output.write(reinterpret_cast<const char*>(boards_.data()),
+               boards_.size() * sizeof(uint32_t));
+  output.write(reinterpret_cast<const char*>(spans_.data()),
+               spans_.size() * sizeof(uint16_t));
+  output.flush();
+  return output.good();
+}
+
+std::optional<std::vector<JourneyTable::Leg>> JourneyTable::GetLegs(
+    size_t from, size_t to) const {
+  if (boards_[Index(from, to)] == UNREACHABLE) {
+    return std::nullopt;
+  }
+  std::vector<Leg> legs;
+  // Идём с конца: остановка посадки последнего участка — конец предыдущего
+  for (size_t current = to; current != from;) {
+    const size_t index = Index(from, current);
+    if (boards_[index] == UNREACHABLE || legs.size() == stop_count_) {
+      return std::nullopt;
+    }
+    legs.push_back({boards_[index], spans_[index]});
+    current = GetBoardStop(boards_[index]);
+  }
+  std::reverse(legs.begin(), legs.end());
+  return legs;
+}
+
+size_t JourneyTable::GetStopCount() const { return stop_count_; }
+
+size_t JourneyTable::GetBoardStop(graph::VertexId position) const {
+  return position_stops_[position - stop_count_];
+}
+
+uint32_t JourneyTable::ComputeChecksum() const {
+  auto bytes = [](const auto& values) {
+    return std::string_view(reinterpret_cast<const char*>(values.data()),
+                            values.size() * sizeof(values[0]));
+  };
+  uint32_t crc = gzip::UpdateCrc32(0, bytes(position_stops_));
+  crc = gzip::UpdateCrc32(crc, bytes(boards_));
+  return gzip::UpdateCrc32(crc, bytes(spans_));
+}
+
+std::vector<uint32_t> JourneyTable::GetPositionStops(
+    const graph::DirectedWeightedGraph<double>& graph, size_t stop_count) {
+  std::vector<uint32_t> position_stops(graph.GetVertexCount() - stop_count, 0);
+  for (graph::VertexId stop = 0; stop < stop_count; ++stop) {
+    for (graph::EdgeId edge_id : graph.GetIncidentEdges(stop)) {
+      const auto& edge = graph.GetEdge(edge_id);
+      position_stops[edge.to - stop_count] = static_cast<uint32_t>(stop);
+    }
+  }
+  return position_stops;
+}
+
+std::vector<uint32_t> JourneyTable::GetRideLengths(
+    const graph::DirectedWeightedGraph<double>& graph, size_t stop_count) {
+  const size_t vertex_count = graph.GetVertexCount();
+  std::vector<uint32_t> lengths(vertex_count - stop_count, 0);
+  // Перегон рейса ведёт из позиции в следующую по номеру
+  for (size_t position = vertex_count; position-- > stop_count;) {
+    for (graph::EdgeId edge_id : graph.GetIncidentEdges(position)) {
+      if (graph.GetEdge(edge_id).to == position + 1) {
+        lengths[position - stop_count] = lengths[position + 1 - stop_count] + 1;
+        break;
+      }
+    }
+  }
+  return lengths;
+}
+
+}  // namespace transpot_guide
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+#include "thread_pool.h"
+
+namespace transpot_guide {
+
+// Заранее посчитанные маршруты между всеми парами остановок.
+// Граф — как у TransportRouter: вершины 0..stop_count-1 — прибытие на
+// остановки, остальные — позиции «в автобусе». Для пары хранится только
+// последний участок поездки (вершина посадки и число перегонов), начало
+// пути восстанавливается из той же таблицы. На пару уходит 6 байт, поэтому
+// таблица строится только для сетей до MAX_STOP_COUNT остановок.
+class JourneyTable {
+ public:
+  struct Leg {
+    graph::VertexId board;  // позиция в автобусе, где была посадка
+    size_t span_count;
+  };
+
+  static constexpr size_t MAX_STOP_COUNT = 10000;  // таблица до 600 МБ
+
+  // Поиски от каждой остановки распределяются по пулу. nullopt, если
+  // остановок больше MAX_STOP_COUNT или в каком-то пути поездка длиннее
+  // MAX_SPAN_COUNT перегонов.
+  static std::optional<JourneyTable> Build(const graph::Router<double>& router,
+                                           size_t stop_count, ThreadPool& pool);
+
+  // nullopt, если файл повреждён или построен для другого графа.
+  // Содержимое сверяется с контрольной суммой и с самим graph, поэтому
+  // загруженная таблица не ссылается за пределы графа.
+  static std::optional<JourneyTable> Load(
+      std::istream& input, uint64_t fingerprint,
+      const graph::DirectedWeightedGraph<double>& graph, size_t stop_count);
+
+  // false при ошибке записи
+  bool Save(std::ostream& output, uint64_t fingerprint) const;
+
+  // Участки пути по порядку; nullopt, если to недостижима из from.
+  // Путь не длиннее stop_count участков, на большем обход прерывается.
+  std::optional<std::vector<Leg>> GetLegs(size_t from, size_t to) const;
+
+  size_t GetStopCount() const;
+
+ private:
+  static constexpr uint32_t UNREACHABLE = UINT32_MAX;
+  static constexpr size_t MAX_SPAN_COUNT = UINT16_MAX;
+
+  size_t Index(size_t from, size_t to) const { return from * stop_count_ + to; }
+  size_t GetBoardStop(graph::VertexId position) const;
+  uint32_t ComputeChecksum() const;
+
+  // Остановка посадки для каждой позиции графа
+  static std::vector<uint32_t> GetPositionStops(
+      const graph::DirectedWeightedGraph<double>& graph, size_t stop_count);
+  // Сколько перегонов можно проехать от каждой позиции до конца рейса
+  static std::vector<uint32_t> GetRideLengths(
+      const graph::DirectedWeightedGraph<double>& graph, size_t stop_count);
+
+  size_t stop_count_ = 0;
+  std::vector<uint32_t> position_stops_;  // остановка посадки для позиции
+  std::vector<uint32_t> boards_;
+  std::vector<uint16_t> spans_;
+};
+
+}  // namespace transpot_guide
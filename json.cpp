@@ -1,6 +1,8 @@
 #include "json.h"
 
+#include <cstdio>
 #include <sstream>
+#include <string_view>
 #include <variant>
 
 static int max_null = 4;
@@ -330,90 +332,165 @@ const Node& Document::GetRoot() const { return root_; }
 
 Document Load(istream& input) { return Document{LoadNode(input)}; }
 
-std::string NodePrinter::operator()(nullptr_t) { return "null"s; }
+namespace {
+// Замена для символа, который нужно экранировать, иначе nullptr
+const char* GetEscape(char c) {
+  switch (c) {
+    case '\\':
+      return R"(\\)";
+    case '\"':
+      return R"(\")";
+    case '\n':
+      return R"(\n)";
+    case '\r':
+      return R"(\r)";
+    case '\t':
+      return R"(\t)";
+    default:
+      return nullptr;
+  }
+}
 
-std::string NodePrinter::operator()(std::string value) {
-  std::string res;
-  res += "\"";
-  for (auto c : value) {
-    if (c == '\\') {
-      res += R"(\\)";
-    } else if (c == '\"') {
-      res += R"(\")";
-    } else if (c == '\n') {
-      res += R"(\n)";
-    } else if (c == '\r') {
-      res += R"(\r)";
-    } else if (c == '\t') {
-      res += R"(\t)";
-    } else {
-      res += c;
+// Передаёт в write куски экранированной строки; участки без спецсимволов
+// идут целиком
+template <typename Writer>
+void Escape(std::string_view value, Writer write) {
+  size_t begin = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (const char* escape = GetEscape(value[i])) {
+      write(value.substr(begin, i - begin));
+      write(escape);
+      begin = i + 1;
     }
   }
-  res += "\"";
-  return res;
+  write(value.substr(begin));
 }
 
-std::string NodePrinter::operator()(double value) {
-  std::ostringstream strs;
-  strs << value;
-  return strs.str();
-}
+struct StreamPrinter {
+  std::ostream& output;
 
-std::string NodePrinter::operator()(int value) {
-  std::ostringstream strs;
-  strs << value;
-  return strs.str();
-}
+  void operator()(std::nullptr_t) const { output << "null"sv; }
 
-std::string NodePrinter::operator()(bool value) {
-  if (value) {
-    return "true"s;
+  void operator()(const std::string& value) const {
+    output.put('"');
+    PrintEscaped(value, output);
+    output.put('"');
   }
 
-  return "false"s;
-}
+  // Как у потока с настройками по умолчанию
+  void operator()(double value) const {
+    char buffer[32];
+    const int size = std::snprintf(buffer, sizeof(buffer), "%g", value);
+    output.write(buffer, size);
+  }
 
-std::string NodePrinter::operator()(Array value) {
-  string out = "[";
-  bool first = true;
-  for (Node& node : value) {
-    if (first) {
+  void operator()(int value) const {
+    char buffer[16];
+    const int size = std::snprintf(buffer, sizeof(buffer), "%d", value);
+    output.write(buffer, size);
+  }
+
+  void operator()(bool value) const {
+    output << (value ? "true"sv : "false"sv);
+  }
+
+  void operator()(const Array& value) const {
+    output.put('[');
+    bool first = true;
+    for (const Node& node : value) {
+      if (!first) {
+        output << ", "sv;
+      }
       first = false;
-      out.append(std::visit(NodePrinter{}, node.GetValue()));
-    } else {
-      out.append(", "s);
-      out.append(std::visit(NodePrinter{}, node.GetValue()));
+      std::visit(*this, node.GetValue());
     }
+    output.put(']');
   }
-  out += "]";
-  return out;
-}
 
-std::string NodePrinter::operator()(Dict value) {
-  string out = "{";
-  bool first = true;
-  for (auto& pair : value) {
-    if (first) {
+  void operator()(const Dict& value) const {
+    output.put('{');
+    bool first = true;
+    for (const auto& [key, node] : value) {
+      if (!first) {
+        output << ", "sv;
+      }
       first = false;
-    } else {
-      out.append(", ");
+      output.put('"');
+      output << key;
+      output << "\": "sv;
+      std::visit(*this, node.GetValue());
     }
-    out.append("\"");
-    out.append(pair.first);
-    out.append("\"");
-    out.append(": ");
-    out.append(std::visit(NodePrinter{}, pair.second.GetValue()));
+    output << " }"sv;
   }
-  out += " }";
-  return out;
+};
+
+template <typename Value>
+std::string PrintToString(const Value& value) {
+  std::ostringstream out;
+  StreamPrinter{out}(value);
+  return out.str();
 }
+}  // namespace
+
+std::string NodePrinter::operator()(nullptr_t) { return "null"s; }
 
-Value Node::GetValue() const { return value_; }
+std::string NodePrinter::operator()(std::string value) {
+  return PrintToString(value);
+}
+
+std::string NodePrinter::operator()(double value) {
+  return PrintToString(value);
+}
+
+std::string NodePrinter::operator()(int value) { return PrintToString(value); }
+
+std::string NodePrinter::operator()(bool value) {
+  return PrintToString(value);
+}
+
+std::string NodePrinter::operator()(Array value) {
+  return PrintToString(value);
+}
+
+std::string NodePrinter::operator()(Dict value) {
+  return PrintToString(value);
+}
+
+const Value& Node::GetValue() const { return value_; }
 
 void Print(const Document& doc, std::ostream& output) {
-  std::string out = std::visit(NodePrinter{}, doc.GetRoot().GetValue());
-  output << out;
+  PrintNode(doc.GetRoot(), output);
+}
+
+void PrintNode(const Node& node, std::ostream& output) {
+  std::visit(StreamPrinter{output}, node.GetValue());
+}
+
+void PrintEscaped(std::string_view value, std::ostream& output) {
+  Escape(value, [&output](std::string_view part) {
+    output.write(part.data(), part.size());
+  });
+}
+
+void EscapingBuffer::Write(std::string_view value) {
+  if (stream_) {
+    PrintEscaped(value, *stream_);
+  } else {
+    Escape(value, [this](std::string_view part) { string_->append(part); });
+  }
+}
+
+EscapingBuffer::int_type EscapingBuffer::overflow(int_type c) {
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    const char ch = traits_type::to_char_type(c);
+    Write({&ch, 1});
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize EscapingBuffer::xsputn(const char* s, std::streamsize n) {
+  Write({s, static_cast<size_t>(n)});
+  return n;
 }
 
 }  // namespace json
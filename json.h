@@ -2,7 +2,9 @@
 
 #include <iostream>
 #include <map>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -54,7 +56,7 @@ class Node {
 //    return this->value_ == right.value_;
 //  }
 
-  Value GetValue() const;
+  const Value& GetValue() const;
 
  private:
   Value value_;
@@ -102,6 +104,34 @@ struct NodePrinter {
 
 void Print(const Document& doc, std::ostream& output);
 
+// Печатает узел прямо в поток, без промежуточных строк
+void PrintNode(const Node& node, std::ostream& output);
+
+// Пишет строку в поток с экранированием, без кавычек
+void PrintEscaped(std::string_view value, std::ostream& output);
+
+// Буфер потока, который экранирует всё записанное и передаёт в output
+// (поток или конец строки). Позволяет отрисовать большой текст, например
+// SVG, сразу внутрь строки JSON:
+//   EscapingBuffer buffer(std::cout);
+//   std::ostream escaped(&buffer);
+//   document.Render(escaped);
+class EscapingBuffer : public std::streambuf {
+ public:
+  explicit EscapingBuffer(std::ostream& output) : stream_(&output) {}
+  explicit EscapingBuffer(std::string& output) : string_(&output) {}
+
+ protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+  void Write(std::string_view value);
+
+  std::ostream* stream_ = nullptr;
+  std::string* string_ = nullptr;
+};
+
 Node LoadNumber(std::istream& input);
 
 }  // namespace json
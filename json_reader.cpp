@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 
@@ -95,6 +96,78 @@ RenderSettings ReadRenderSettings(json::Dict data) {
   for (auto& color : data["color_palette"].AsArray()) {
     settings.color_palette.push_back(ParsingColor(color));
   }
+  if (data.count("lod_tolerance"s)) {
+    settings.lod_tolerance = data["lod_tolerance"s].AsDouble();
+  }
+  if (data.count("label_culling"s)) {
+    settings.label_culling = data["label_culling"s].AsBool();
+  }
+  if (data.count("shared_segments"s)) {
+    settings.shared_segments = data["shared_segments"s].AsBool();
+  }
+  if (data.count("map_cache_size"s)) {
+    const int cache_size = data["map_cache_size"s].AsInt();
+    if (cache_size < 0) {
+      throw std::invalid_argument("Negative map cache size: "s +
+                                  std::to_string(cache_size));
+    }
+    settings.map_cache_size = cache_size;
+  }
+  return settings;
+}
+
+CatalogueSettings ReadCatalogueSettings(json::Dict data) {
+  CatalogueSettings settings;
+  if (data.count("distance_model"s)) {
+    const std::string model = data["distance_model"s].AsString();
+    if (model == "equirectangular"s) {
+      settings.distance_model = detail::DistanceModel::EQUIRECTANGULAR;
+    } else if (model != "exact"s) {
+      throw std::invalid_argument("Unknown distance model: "s + model);
+    }
+  }
+  if (data.count("walking_radius"s)) {
+    settings.walking_radius = data["walking_radius"s].AsDouble();
+  }
+  return settings;
+}
+
+RoutingSettings ReadRoutingSettings(json::Dict data) {
+  RoutingSettings settings;
+  settings.bus_wait_time = data["bus_wait_time"s].AsInt();
+  settings.bus_velocity = data["bus_velocity"s].AsDouble();
+  if (data.count("search_mode"s)) {
+    const std::string mode = data["search_mode"s].AsString();
+    if (mode == "astar"s) {
+      settings.search_mode = SearchMode::ASTAR;
+    } else if (mode == "contraction_hierarchies"s) {
+      settings.search_mode = SearchMode::CONTRACTION_HIERARCHIES;
+    } else if (mode != "dijkstra"s) {
+      throw std::invalid_argument("Unknown search mode: "s + mode);
+    }
+  }
+  if (data.count("report_expansions"s)) {
+    settings.report_expansions = data["report_expansions"s].AsBool();
+  }
+  if (data.count("precompute_journeys"s)) {
+    settings.precompute_journeys = data["precompute_journeys"s].AsBool();
+  }
+  if (data.count("journey_table_file"s)) {
+    settings.journey_table_file = data["journey_table_file"s].AsString();
+  }
+  return settings;
+}
+
+output::ExecutionSettings ReadExecutionSettings(json::Dict data) {
+  output::ExecutionSettings settings;
+  if (data.count("threads"s)) {
+    const int threads = data["threads"s].AsInt();
+    if (threads < 0) {
+      throw std::invalid_argument("Negative thread count: "s +
+                                  std::to_string(threads));
+    }
+    settings.threads = threads;
+  }
   return settings;
 }
 
@@ -8,8 +8,10 @@
 
 #include "json.h"
 #include "map_renderer.h"
+#include "request_handler.h"
 #include "svg.h"
 #include "transport_catalogue.h"
+#include "transport_router.h"
 
 namespace transpot_guide {
 namespace input {
@@ -20,6 +22,12 @@ void InputData(::transpot_guide::TransportCatalogue& transport_catalog,
 svg::Color ParsingColor(json::Node& color);
 
 RenderSettings ReadRenderSettings(json::Dict settings);
+
+CatalogueSettings ReadCatalogueSettings(json::Dict settings);
+
+RoutingSettings ReadRoutingSettings(json::Dict settings);
+
+output::ExecutionSettings ReadExecutionSettings(json::Dict settings);
 }  // namespace input
 
 }  // namespace transpot_guide
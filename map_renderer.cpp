@@ -3,268 +3,1308 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <string_view>
 
 using namespace std::literals;
 
 bool IsZero(double value) { return std::abs(value) < EPSILON; }
 
-SphereProjector CreatorSphereProjector(std::deque<Stop*>& stops,
-                                       RenderSettings& settings) {
-  std::vector<transpot_guide::detail::Coordinates> points;
-  for (auto stop : stops) {
-    points.push_back(stop->coordinates_);
-  }
-  return SphereProjector(points.begin(), points.end(), settings.width,
-                         settings.height, settings.padding);
-}
-
-std::vector<svg::Polyline> DrawLineofRoad(const std::deque<Bus*>& buses,
-                                          RenderSettings& settings,
-                                          SphereProjector& projector) {
-  std::vector<svg::Polyline> lines;
-  size_t cnt_color_palette = 0;
-  for (const auto bus : buses) {
-    if (!bus->route_stops_.empty()) {
-	svg::Polyline line;
-      for (auto& stop : bus->route_stops_) {
-        line.AddPoint(projector(stop->coordinates_));
-        line.SetStrokeColor(settings.color_palette[cnt_color_palette]);
-        line.SetStrokeWidth(settings.line_width);
-        line.SetFillColor(svg::NoneColor);
-        line.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        line.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+namespace {
+uint64_t ComputeFingerprint(const RenderSettings& settings) {
+  std::ostringstream out;
+  out.precision(17);
+  auto print_color = [&out](const svg::Color& color) {
+    out << std::visit(svg::ColorPrinter{}, color) << ';';
+  };
+  out << settings.width << ';' << settings.height << ';' << settings.padding
+      << ';' << settings.stop_radius << ';' << settings.line_width << ';'
+      << settings.bus_label_front_size << ';' << settings.bus_label_offset.x
+      << ';' << settings.bus_label_offset.y << ';'
+      << settings.stop_label_font_size << ';' << settings.stop_label_offset.x
+      << ';' << settings.stop_label_offset.y << ';'
+      << settings.underlayer_width << ';' << settings.lod_tolerance << ';'
+      << settings.label_culling << ';' << settings.shared_segments << ';';
+  print_color(settings.underlayer_color);
+  for (const svg::Color& color : settings.color_palette) {
+    print_color(color);
+  }
+  return std::hash<std::string>{}(out.str());
+}
+
+// Уровень тайлов, при котором 2^z ещё помещается в int
+constexpr int MAX_TILE_ZOOM = 30;
+
+// Палитра повторяется по кругу
+svg::Color GetPaletteColor(const RenderSettings& settings, size_t index) {
+  if (settings.color_palette.empty()) {
+    return svg::NoneColor;
+  }
+  return settings.color_palette[index % settings.color_palette.size()];
+}
+
+// Подпись у второй конечной, если маршрут не кольцевой и конечные разные
+bool HasSecondTerminal(const Bus& bus) {
+  return !bus.is_roundtrip &&
+         bus.route_stops_.front()->name_ != bus.route_stops_.back()->name_;
+}
+
+// Число символов UTF-8 — для оценки ширины подписи
+size_t CountChars(std::string_view text) {
+  return std::count_if(text.begin(), text.end(), [](char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+  });
+}
+
+// Атрибуты оформления всех объектов карты, переведённые в текст один раз
+// на отрисовку. Строки линий и названий автобусов — по цветам палитры.
+struct MapStyles {
+  std::vector<svg::PreparedAttrs> lines;
+  std::vector<svg::PreparedAttrs> shared_lines;  // цвет копии общего участка
+  svg::PreparedAttrs shared_geometry;  // оформление общего участка без цвета
+  std::vector<svg::PreparedAttrs> bus_labels;
+  svg::PreparedAttrs bus_underlayer;
+  svg::PreparedAttrs stop_point;
+  svg::PreparedAttrs stop_label;
+  svg::PreparedAttrs stop_underlayer;
+};
+
+MapStyles PrepareStyles(const RenderSettings& settings) {
+  MapStyles styles;
+  const size_t color_count = std::max<size_t>(settings.color_palette.size(), 1);
+  for (size_t i = 0; i < color_count; ++i) {
+    svg::Polyline line;
+    line.SetStrokeColor(GetPaletteColor(settings, i))
+        .SetStrokeWidth(settings.line_width)
+        .SetFillColor(svg::NoneColor)
+        .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+        .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    styles.lines.push_back(line.PrepareAttrs());
+
+    svg::Use shared_line;
+    shared_line.SetStrokeColor(GetPaletteColor(settings, i));
+    styles.shared_lines.push_back(shared_line.PrepareAttrs());
+
+    svg::Text label;
+    label.SetFillColor(GetPaletteColor(settings, i));
+    styles.bus_labels.push_back(label.PrepareAttrs());
+  }
+
+  svg::Polyline shared_geometry;
+  shared_geometry.SetStrokeWidth(settings.line_width)
+      .SetFillColor(svg::NoneColor)
+      .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+      .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+  styles.shared_geometry = shared_geometry.PrepareAttrs();
+
+  svg::Text underlayer;
+  underlayer.SetFillColor(settings.underlayer_color)
+      .SetStrokeColor(settings.underlayer_color)
+      .SetStrokeWidth(settings.underlayer_width)
+      .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+      .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+  styles.bus_underlayer = underlayer.PrepareAttrs();
+  styles.stop_underlayer = styles.bus_underlayer;
+
+  svg::Circle stop_point;
+  stop_point.SetFillColor("white"s);
+  styles.stop_point = stop_point.PrepareAttrs();
+
+  svg::Text stop_label;
+  stop_label.SetFillColor("black"s);
+  styles.stop_label = stop_label.PrepareAttrs();
+  return styles;
+}
+
+// Линия маршрута без точек
+svg::Polyline MakeBusLine(const MapStyles& styles, size_t color_index) {
+  svg::Polyline line;
+  line.SetPreparedAttrs(styles.lines[color_index % styles.lines.size()]);
+  return line;
+}
+
+// Подложка и название автобуса у конечной
+void AddBusLabel(std::vector<svg::Text>& texts, svg::Point position,
+                 const Bus& bus, const RenderSettings& settings,
+                 const MapStyles& styles, size_t color_index) {
+  svg::Text text;
+  text.SetPosition(position)
+      .SetOffset(settings.bus_label_offset)
+      .SetFontSize(settings.bus_label_front_size)
+      .SetFontFamily("Verdana"s)
+      .SetFontWeight("bold")
+      .SetData(bus.name_);
+  svg::Text underlayer = text;
+  underlayer.SetPreparedAttrs(styles.bus_underlayer);
+  text.SetPreparedAttrs(
+      styles.bus_labels[color_index % styles.bus_labels.size()]);
+  texts.push_back(std::move(underlayer));
+  texts.push_back(std::move(text));
+}
+
+svg::Circle MakeStopPoint(svg::Point position, const RenderSettings& settings,
+                          const MapStyles& styles) {
+  svg::Circle stop_point;
+  stop_point.SetCenter(position)
+      .SetRadius(settings.stop_radius)
+      .SetPreparedAttrs(styles.stop_point);
+  return stop_point;
+}
+
+// Подложка и название остановки
+void AddStopLabel(std::vector<svg::Text>& texts, svg::Point position,
+                  const Stop& stop, const RenderSettings& settings,
+                  const MapStyles& styles) {
+  svg::Text text;
+  text.SetPosition(position)
+      .SetOffset(settings.stop_label_offset)
+      .SetFontSize(settings.stop_label_font_size)
+      .SetFontFamily("Verdana"s)
+      .SetData(stop.name_);
+  svg::Text underlayer = text;
+  underlayer.SetPreparedAttrs(styles.stop_underlayer);
+  text.SetPreparedAttrs(styles.stop_label);
+  texts.push_back(std::move(underlayer));
+  texts.push_back(std::move(text));
+}
+
+// Запас в пикселях, на который подпись может отойти от своей точки.
+// Ширина символа не больше размера шрифта.
+double GetLabelMargin(svg::Point offset, double font_size, size_t chars,
+                      double underlayer_width) {
+  return std::max(std::abs(offset.x), std::abs(offset.y)) +
+         font_size * std::max<size_t>(chars, 1) + underlayer_width;
+}
+
+// Упрощение линии маршрута при lod_tolerance > 0: точки округляются до
+// целых пикселей, совпадающие соседние выбрасываются, затем Дуглас — Пекер
+// убирает точки, отстоящие от упрощённой линии меньше чем на tolerance
+void SimplifyLine(std::vector<svg::Point>& points, double tolerance) {
+  for (svg::Point& point : points) {
+    // + 0. убирает -0 после округления
+    point.x = std::round(point.x) + 0.;
+    point.y = std::round(point.y) + 0.;
+  }
+  points.erase(std::unique(points.begin(), points.end(),
+                           [](svg::Point left, svg::Point right) {
+                             return left.x == right.x && left.y == right.y;
+                           }),
+               points.end());
+  if (points.size() < 3) {
+    return;
+  }
+
+  // Квадрат расстояния от point до отрезка [from, to]
+  auto distance2 = [](svg::Point point, svg::Point from, svg::Point to) {
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    const double length2 = dx * dx + dy * dy;
+    double t = 0;
+    if (length2 > 0) {
+      t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) /
+                         length2,
+                     0., 1.);
+    }
+    const double px = from.x + t * dx - point.x;
+    const double py = from.y + t * dy - point.y;
+    return px * px + py * py;
+  };
+
+  std::vector<bool> keep(points.size(), false);
+  keep.front() = true;
+  keep.back() = true;
+  std::vector<std::pair<size_t, size_t>> ranges = {{0, points.size() - 1}};
+  while (!ranges.empty()) {
+    const auto [from, to] = ranges.back();
+    ranges.pop_back();
+    double max_distance2 = tolerance * tolerance;
+    size_t farthest = from;
+    for (size_t i = from + 1; i < to; ++i) {
+      const double d = distance2(points[i], points[from], points[to]);
+      if (d > max_distance2) {
+        max_distance2 = d;
+        farthest = i;
       }
+    }
+    if (farthest != from) {
+      keep[farthest] = true;
+      ranges.push_back({from, farthest});
+      ranges.push_back({farthest, to});
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (keep[i]) {
+      points[kept++] = points[i];
+    }
+  }
+  points.resize(kept);
+}
+
+// Точки линии в line, при lod_tolerance > 0 — упрощённые
+void AddLinePoints(svg::Polyline& line, std::vector<svg::Point>& points,
+                   const RenderSettings& settings) {
+  if (settings.lod_tolerance > 0) {
+    SimplifyLine(points, settings.lod_tolerance);
+  }
+  for (svg::Point point : points) {
+    line.AddPoint(point);
+  }
+  points.clear();
+}
+
+// Доля размера шрифта на символ и над базовой линией — для оценки
+// прямоугольника подписи
+constexpr double LABEL_CHAR_WIDTH = 0.6;
+constexpr double LABEL_ASCENT = 0.8;
+
+transpot_guide::PackedRTree::Box GetLabelBox(svg::Point position,
+                                             svg::Point offset,
+                                             double font_size, size_t chars,
+                                             double underlayer_width) {
+  const double x = position.x + offset.x;
+  const double y = position.y + offset.y;
+  const double pad = underlayer_width / 2;
+  return {x - pad, y - font_size * LABEL_ASCENT - pad,
+          x + chars * font_size * LABEL_CHAR_WIDTH + pad,
+          y + font_size * (1 - LABEL_ASCENT) + pad};
+}
+
+// Подпись-кандидат для отбора по наложениям
+struct LabelCandidate {
+  svg::Point position;  // точка, к которой привязана подпись
+  size_t chars;
+  bool is_bus;
+  size_t bus_count;  // у остановки
+};
+
+// Отбор подписей без наложений. Подписи автобусов важнее подписей
+// остановок, остановки с большим числом автобусов важнее, при равенстве
+// важнее идущая раньше. Подпись, задевающая уже принятую, не рисуется.
+// Принятые подписи записываются во все клетки равномерной сетки на
+// экране, которые задевают, поэтому проверка почти линейна.
+std::vector<bool> CullLabels(const std::vector<LabelCandidate>& candidates,
+                             const RenderSettings& settings) {
+  std::vector<transpot_guide::PackedRTree::Box> boxes;
+  double cell_size = 1;
+  for (const LabelCandidate& candidate : candidates) {
+    boxes.push_back(candidate.is_bus
+                        ? GetLabelBox(candidate.position,
+                                      settings.bus_label_offset,
+                                      settings.bus_label_front_size,
+                                      candidate.chars,
+                                      settings.underlayer_width)
+                        : GetLabelBox(candidate.position,
+                                      settings.stop_label_offset,
+                                      settings.stop_label_font_size,
+                                      candidate.chars,
+                                      settings.underlayer_width));
+    cell_size = std::max(cell_size, boxes.back().max_y - boxes.back().min_y);
+  }
 
-      if (!bus->is_roundtrip) {
-        for (auto itr = bus->route_stops_.rbegin() + 1;
-             itr < bus->route_stops_.rend(); ++itr) {
-          line.AddPoint(projector((*itr)->coordinates_));
+  std::vector<size_t> order(candidates.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right) {
+    if (candidates[left].is_bus != candidates[right].is_bus) {
+      return candidates[left].is_bus;
+    }
+    return candidates[left].bus_count > candidates[right].bus_count;
+  });
+
+  auto cell = [cell_size](double value) {
+    return static_cast<int32_t>(std::floor(value / cell_size));
+  };
+  std::unordered_map<uint64_t, std::vector<uint32_t>> grid;
+  std::vector<bool> keep(candidates.size(), false);
+  for (size_t index : order) {
+    const auto& box = boxes[index];
+    const int32_t min_x = cell(box.min_x);
+    const int32_t max_x = cell(box.max_x);
+    const int32_t min_y = cell(box.min_y);
+    const int32_t max_y = cell(box.max_y);
+    auto key = [](int32_t x, int32_t y) {
+      return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+             static_cast<uint32_t>(y);
+    };
+    bool free = true;
+    for (int32_t x = min_x; x <= max_x && free; ++x) {
+      for (int32_t y = min_y; y <= max_y && free; ++y) {
+        auto found = grid.find(key(x, y));
+        if (found == grid.end()) {
+          continue;
+        }
+        for (uint32_t placed : found->second) {
+          if (boxes[placed].Intersects(box)) {
+            free = false;
+            break;
+          }
         }
       }
+    }
+    if (!free) {
+      continue;
+    }
+    keep[index] = true;
+    for (int32_t x = min_x; x <= max_x; ++x) {
+      for (int32_t y = min_y; y <= max_y; ++y) {
+        grid[key(x, y)].push_back(static_cast<uint32_t>(index));
+      }
+    }
+  }
+  return keep;
+}
+
+// Экранные координаты остановок в проекции всей карты, индекс — Stop::id_.
+// Широты и долготы собираются в плотные массивы: границы считаются по
+// остановкам stops, проекция — одним проходом по всем остановкам каталога.
+struct StopScreen {
+  SphereProjector projector;
+  std::vector<svg::Point> points;
+};
 
-//      if (bus->route_stops_.size() == 1) {
-//	  line.AddPoint(projector(bus->route_stops_[0]->coordinates_));
-//      }
+template <typename Stops>
+StopScreen ProjectStops(const std::deque<Stop>& stop_list, const Stops& stops,
+                        const RenderSettings& settings) {
+  const size_t count = stop_list.size();
+  std::vector<double> lats(count);
+  std::vector<double> lngs(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto coordinates = stop_list[i].GetCoordinates();
+    lats[i] = coordinates.lat;
+    lngs[i] = coordinates.lng;
+  }
+  std::optional<SphereProjector::Bounds> bounds;
+  for (const Stop* stop : stops) {
+    const double lat = lats[stop->id_];
+    const double lng = lngs[stop->id_];
+    if (!bounds) {
+      bounds = SphereProjector::Bounds{lat, lat, lng, lng};
+      continue;
+    }
+    bounds->min_lat = std::min(bounds->min_lat, lat);
+    bounds->max_lat = std::max(bounds->max_lat, lat);
+    bounds->min_lon = std::min(bounds->min_lon, lng);
+    bounds->max_lon = std::max(bounds->max_lon, lng);
+  }
+  StopScreen screen{SphereProjector(bounds, settings.width, settings.height,
+                                    settings.padding),
+                    std::vector<svg::Point>(count)};
+  screen.projector.ProjectBatch(lats.data(), lngs.data(), count,
+                                screen.points.data());
+  return screen;
+}
 
+// Какие подписи рисовать после отбора: у автобуса i подписи конечных
+// с номерами 2i и 2i + 1, у остановок — по номеру остановки
+struct LabelMask {
+  std::vector<bool> terminals;
+  std::vector<bool> stops;
+};
 
-      if (cnt_color_palette < settings.color_palette.size()) {
-        ++cnt_color_palette;
-      } else {
-        cnt_color_palette = 0;
+// Линия всего маршрута: прямой путь и, если маршрут не кольцевой, обратный.
+// points — рабочий буфер.
+svg::Polyline MakeRouteLine(const Bus& bus, size_t color_index,
+                            const std::vector<svg::Point>& screen,
+                            const RenderSettings& settings,
+                            const MapStyles& styles,
+                            std::vector<svg::Point>& points) {
+  const auto& route = bus.route_stops_;
+  svg::Polyline line = MakeBusLine(styles, color_index);
+  for (const Stop* stop : route) {
+    points.push_back(screen[stop->id_]);
+  }
+  if (!bus.is_roundtrip) {
+    for (auto itr = route.rbegin() + 1; itr < route.rend(); ++itr) {
+      points.push_back(screen[(*itr)->id_]);
+    }
+  }
+  AddLinePoints(line, points, settings);
+  return line;
+}
+
+// Общий участок: цепочка подряд идущих отрезков между остановками,
+// по которым проходит один и тот же набор автобусов
+struct SharedChain {
+  std::vector<const Stop*> stops;
+  std::vector<uint32_t> buses;  // номера автобусов по возрастанию
+};
+
+constexpr uint32_t NO_CHAIN = std::numeric_limits<uint32_t>::max();
+
+// Отрезки прямых путей отобранных автобусов без учёта направления.
+// Обратный путь некольцевого маршрута идёт по тем же отрезкам.
+struct SharedSegments {
+  std::unordered_map<uint64_t, uint32_t> edge_indices;
+  std::vector<std::vector<uint32_t>> edge_buses;  // по возрастанию
+  // Общий участок, в который вынесен отрезок, или NO_CHAIN
+  std::vector<uint32_t> edge_chains;
+  std::vector<SharedChain> chains;
+};
+
+uint64_t GetEdgeKey(const Stop* from, const Stop* to) {
+  const uint64_t low = std::min(from->id_, to->id_);
+  const uint64_t high = std::max(from->id_, to->id_);
+  return low << 32 | high;
+}
+
+// Примерная длина в SVG вершины ломаной, элемента <use> и описания
+// участка в <defs>: по ней решается, выгодно ли выносить участок
+constexpr size_t SHARED_POINT_CHARS = 18;
+constexpr size_t SHARED_USE_CHARS = 76;
+constexpr size_t SHARED_DEF_CHARS = 120;
+
+bool IsWorthSharing(size_t point_count, size_t bus_count) {
+  return bus_count > 1 &&
+         point_count * (bus_count - 1) * SHARED_POINT_CHARS >
+             bus_count * SHARED_USE_CHARS + SHARED_DEF_CHARS;
+}
+
+// Единичный вектор от from к to на экране, 0 — если отрезок вырожден
+svg::Point GetDirection(svg::Point from, svg::Point to) {
+  const double dx = to.x - from.x;
+  const double dy = to.y - from.y;
+  const double length = std::hypot(dx, dy);
+  if (length < EPSILON) {
+    return {0, 0};
+  }
+  return {dx / length, dy / length};
+}
+
+// Копия общего участка — его параллельный перенос, а не параллельная
+// линия: отрезок, повёрнутый к хорде участка на угол a, отстоит от
+// соседней полосы на cos(a) её ширины. Поэтому отрезки цепочки отклоняются
+// от направления её первого отрезка не больше чем на 10 градусов, тогда
+// к хорде — не больше чем на 20, и полосы сужаются не больше чем на 6%.
+const double MAX_SHARED_TURN_COS =
+    std::cos(10 * transpot_guide::detail::DEGREE_TO_RADIAN);
+
+// Цепочки строит автобус с наименьшим номером из набора. В общие участки
+// выносятся только почти прямые цепочки, для которых это короче, чем
+// повторять вершины. screen — экранные координаты по Stop::id_.
+template <typename Buses>
+SharedSegments FindSharedSegments(const Buses& buses,
+                                  const std::vector<bool>& selected,
+                                  const std::vector<svg::Point>& screen) {
+  SharedSegments segments;
+  for (uint32_t i = 0; i < buses.size(); ++i) {
+    if (!selected[i]) {
+      continue;
+    }
+    const auto& route = buses[i]->route_stops_;
+    for (size_t j = 0; j + 1 < route.size(); ++j) {
+      if (route[j] == route[j + 1]) {
+        continue;
+      }
+      const auto [itr, inserted] = segments.edge_indices.emplace(
+          GetEdgeKey(route[j], route[j + 1]), segments.edge_buses.size());
+      if (inserted) {
+        segments.edge_buses.emplace_back();
+      }
+      auto& edge = segments.edge_buses[itr->second];
+      if (edge.empty() || edge.back() != i) {
+        edge.push_back(i);
       }
-      lines.push_back(line);
-    }
-  }
-  return lines;
-}
-
-std::vector<svg::Text> DrawNameOfRoad(const std::deque<Bus*>& buses,
-                                      RenderSettings& settings,
-                                      SphereProjector& projector) {
-  std::vector<svg::Text> NameOfRoad;
-  size_t cnt_color_palette = 0;
-  for (const auto bus : buses) {
-    if (!bus->route_stops_.empty()) {
-      if (bus->is_roundtrip || bus->route_stops_.front()->name_ == bus->route_stops_.back()->name_) {
-        svg::Text text_first;
-        svg::Text text_second;
-        text_first.SetPosition(projector(bus->route_stops_[0]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.color_palette[cnt_color_palette]);
-
-        text_second.SetPosition(projector(bus->route_stops_[0]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.underlayer_color)
-            .SetStrokeColor(settings.underlayer_color)
-            .SetStrokeWidth(settings.underlayer_width)
-            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-        NameOfRoad.push_back(text_second);
-        NameOfRoad.push_back(text_first);
+    }
+  }
 
-      } else {
-        svg::Text text_first_first_stop;
-        svg::Text text_second_first_stop;
-        svg::Text text_first_secon_stop;
-        svg::Text text_second_second_stop;
-
-        text_first_first_stop
-            .SetPosition(projector(bus->route_stops_[0]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.color_palette[cnt_color_palette]);
-
-        text_second_first_stop
-            .SetPosition(projector(bus->route_stops_[0]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.underlayer_color)
-            .SetStrokeColor(settings.underlayer_color)
-            .SetStrokeWidth(settings.underlayer_width)
-            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-        text_first_secon_stop
-            .SetPosition(projector(
-                bus->route_stops_[(bus->route_stops_.size() - 1)]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.color_palette[cnt_color_palette]);
-
-        text_second_second_stop
-            .SetPosition(projector(
-                bus->route_stops_[(bus->route_stops_.size() - 1)]->coordinates_))
-            .SetOffset(settings.bus_label_offset)
-            .SetFontSize(settings.bus_label_front_size)
-            .SetFontFamily("Verdana"s)
-            .SetFontWeight("bold")
-            .SetData(bus->name_)
-            .SetFillColor(settings.underlayer_color)
-            .SetStrokeColor(settings.underlayer_color)
-            .SetStrokeWidth(settings.underlayer_width)
-            .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-            .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-        NameOfRoad.push_back(text_second_first_stop);
-        NameOfRoad.push_back(text_first_first_stop);
-
-        NameOfRoad.push_back(text_second_second_stop);
-        NameOfRoad.push_back(text_first_secon_stop);
+  const auto& edge_buses = segments.edge_buses;
+  std::vector<SharedChain> candidates;
+  std::vector<std::vector<uint32_t>> candidate_edges;
+  std::vector<bool> used(edge_buses.size(), false);
+  for (uint32_t i = 0; i < buses.size(); ++i) {
+    if (!selected[i]) {
+      continue;
+    }
+    const auto& route = buses[i]->route_stops_;
+    bool open = false;  // продолжается ли цепочка с прошлого отрезка
+    uint32_t prev_edge = 0;
+    svg::Point chain_direction{0, 0};  // первого невырожденного отрезка
+    for (size_t j = 0; j + 1 < route.size(); ++j) {
+      if (route[j] == route[j + 1]) {
+        continue;
+      }
+      const uint32_t edge =
+          segments.edge_indices.at(GetEdgeKey(route[j], route[j + 1]));
+      if (used[edge] || edge_buses[edge].front() != i) {
+        open = false;
+        continue;
       }
+      used[edge] = true;
+      const svg::Point direction =
+          GetDirection(screen[route[j]->id_], screen[route[j + 1]->id_]);
+      const bool degenerate = direction.x == 0 && direction.y == 0;
+      const bool straight =
+          degenerate || (chain_direction.x == 0 && chain_direction.y == 0) ||
+          direction.x * chain_direction.x + direction.y * chain_direction.y >=
+              MAX_SHARED_TURN_COS;
+      if (!open || edge_buses[prev_edge] != edge_buses[edge] || !straight) {
+        candidates.push_back({{route[j]}, edge_buses[edge]});
+        candidate_edges.emplace_back();
+        chain_direction = direction;
+      } else if (chain_direction.x == 0 && chain_direction.y == 0) {
+        chain_direction = direction;
+      }
+      candidates.back().stops.push_back(route[j + 1]);
+      candidate_edges.back().push_back(edge);
+      open = true;
+      prev_edge = edge;
+    }
+  }
 
-      if (cnt_color_palette < settings.color_palette.size()) {
-        ++cnt_color_palette;
+  segments.edge_chains.assign(edge_buses.size(), NO_CHAIN);
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (!IsWorthSharing(candidates[i].stops.size(),
+                        candidates[i].buses.size())) {
+      continue;
+    }
+    for (uint32_t edge : candidate_edges[i]) {
+      segments.edge_chains[edge] = segments.chains.size();
+    }
+    segments.chains.push_back(std::move(candidates[i]));
+  }
+  return segments;
+}
+
+// Единичная нормаль к отрезку from-to на экране, 0 — если он вырожден
+svg::Point GetNormal(svg::Point from, svg::Point to) {
+  const svg::Point direction = GetDirection(from, to);
+  return {-direction.y, direction.x};
+}
+
+// Полосы общего отрезка вместе не шире стольких линий: при большем числе
+// автобусов полосы сужаются и перекрываются
+constexpr double MAX_LANES_WIDTH = 8;
+
+// Сдвиг полосы автобуса номер slot из count: полосы шириной line_width
+// идут вдоль normal симметрично относительно линии
+svg::Point GetLaneOffset(svg::Point normal, size_t slot, size_t count,
+                         double line_width) {
+  const double width =
+      line_width * std::min(1.0, MAX_LANES_WIDTH / static_cast<double>(count));
+  const double lane = (slot - (count - 1) / 2.0) * width;
+  return {normal.x * lane, normal.y * lane};
+}
+
+// Линии маршрутов в режиме общих участков, рисуются только прямые пути.
+// Выгодные почти прямые общие участки описываются один раз в <defs>, и
+// каждый их автобус рисует свою сдвинутую поперёк хорды копию <use>.
+// Прочие отрезки идут в ломаную автобуса со сдвигом на его полосу, полосы
+// упорядочены по номеру автобуса. Автобусы без отрезков между разными
+// остановками рисуются как обычно.
+template <typename Buses>
+void RenderSharedLines(const Buses& buses, const std::vector<bool>& selected,
+                       const std::vector<svg::Point>& screen,
+                       const RenderSettings& settings,
+                       const MapStyles& styles,
+                       const svg::RenderContext& context) {
+  const SharedSegments segments =
+      FindSharedSegments(buses, selected, screen);
+  const auto& chains = segments.chains;
+  std::vector<svg::Point> points;
+  std::vector<svg::Point> chain_normals;
+  for (size_t i = 0; i < chains.size(); ++i) {
+    if (i == 0) {
+      svg::Document::RenderDefsBegin(context);
+    }
+    const auto& stops = chains[i].stops;
+    for (const Stop* stop : stops) {
+      points.push_back(screen[stop->id_]);
+    }
+    // Копии сдвигаются поперёк хорды, у замкнутого участка — первого отрезка
+    svg::Point normal = GetNormal(points.front(), points.back());
+    if (normal.x == 0 && normal.y == 0) {
+      normal = GetNormal(points[0], points[1]);
+    }
+    chain_normals.push_back(normal);
+    svg::Polyline line;
+    line.SetId("s" + std::to_string(i))
+        .SetPreparedAttrs(styles.shared_geometry);
+    AddLinePoints(line, points, settings);
+    line.Render(context.Indented());
+    if (i + 1 == chains.size()) {
+      svg::Document::RenderDefsEnd(context);
+    }
+  }
+
+  // Последний автобус, нарисовавший копию участка
+  std::vector<uint32_t> chain_drawn(chains.size(), NO_CHAIN);
+  auto flush = [&](size_t bus) {
+    if (!points.empty()) {
+      svg::Polyline line = MakeBusLine(styles, bus);
+      AddLinePoints(line, points, settings);
+      line.Render(context);
+    }
+  };
+  for (uint32_t i = 0; i < buses.size(); ++i) {
+    if (!selected[i]) {
+      continue;
+    }
+    const auto& route = buses[i]->route_stops_;
+    bool has_edges = false;
+    for (size_t j = 0; j + 1 < route.size(); ++j) {
+      const Stop* from = route[j];
+      const Stop* to = route[j + 1];
+      if (from == to) {
+        continue;
+      }
+      has_edges = true;
+      const uint32_t edge = segments.edge_indices.at(GetEdgeKey(from, to));
+      const auto& edge_buses = segments.edge_buses[edge];
+      const size_t slot =
+          std::lower_bound(edge_buses.begin(), edge_buses.end(), i) -
+          edge_buses.begin();
+      const uint32_t chain = segments.edge_chains[edge];
+      if (chain != NO_CHAIN) {
+        flush(i);
+        if (chain_drawn[chain] != i) {
+          chain_drawn[chain] = i;
+          svg::Use copy;
+          copy.SetHref("s" + std::to_string(chain))
+              .SetOffset(GetLaneOffset(chain_normals[chain], slot,
+                                       edge_buses.size(),
+                                       settings.line_width))
+              .SetPreparedAttrs(
+                  styles.shared_lines[i % styles.shared_lines.size()]);
+          copy.Render(context);
+        }
+        continue;
+      }
+      // Нормаль берётся по направлению от меньшего номера остановки,
+      // чтобы полосы не менялись местами у встречных автобусов
+      const bool forward = from->id_ < to->id_;
+      const svg::Point normal =
+          forward ? GetNormal(screen[from->id_], screen[to->id_])
+                  : GetNormal(screen[to->id_], screen[from->id_]);
+      const svg::Point offset = GetLaneOffset(normal, slot, edge_buses.size(),
+                                              settings.line_width);
+      const svg::Point start{screen[from->id_].x + offset.x,
+                             screen[from->id_].y + offset.y};
+      if (points.empty()) {
+        points.push_back(start);
       } else {
-        cnt_color_palette = 0;
+        // Вершина между отрезками — посередине между их полосами
+        points.back() = {(points.back().x + start.x) / 2,
+                         (points.back().y + start.y) / 2};
       }
+      points.push_back(
+          {screen[to->id_].x + offset.x, screen[to->id_].y + offset.y});
+    }
+    flush(i);
+    if (!has_edges) {
+      MakeRouteLine(*buses[i], i, screen, settings, styles, points)
+          .Render(context);
     }
   }
-  return NameOfRoad;
 }
 
-std::vector<svg::Circle> DrawStop(const std::deque<Stop*>& stops,
-                                  RenderSettings& settings,
-                                  SphereProjector& projector) {
-  std::vector<svg::Circle> stops_point;
-    for (const auto stop : stops) {
-      svg::Circle stop_point;
-      stop_point.SetCenter(projector(stop->coordinates_))
-          .SetRadius(settings.stop_radius)
-          .SetFillColor("white"s);
-      stops_point.push_back(stop_point);
+// Отбор подписей всей карты среди конечных отобранных автобусов
+// и отобранных остановок. bus_count(i) — число автобусов у stops[i],
+// screen — экранные координаты по Stop::id_.
+template <typename Buses, typename Stops, typename BusCount>
+LabelMask ChooseLabels(const Buses& buses, const std::vector<bool>& bus_selected,
+                       const Stops& stops,
+                       const std::vector<bool>& stop_selected,
+                       BusCount bus_count,
+                       const std::vector<svg::Point>& screen,
+                       const RenderSettings& settings) {
+  std::vector<LabelCandidate> candidates;
+  std::vector<size_t> terminals;  // 2 * номер автобуса + номер конечной
+  for (size_t i = 0; i < buses.size(); ++i) {
+    if (!bus_selected[i]) {
+      continue;
     }
+    const auto& route = buses[i]->route_stops_;
+    const size_t chars = CountChars(buses[i]->name_);
+    candidates.push_back(
+        {screen[route.front()->id_], chars, true, 0});
+    terminals.push_back(2 * i);
+    if (HasSecondTerminal(*buses[i])) {
+      candidates.push_back(
+          {screen[route.back()->id_], chars, true, 0});
+      terminals.push_back(2 * i + 1);
+    }
+  }
+  std::vector<size_t> stop_indices;
+  for (size_t i = 0; i < stops.size(); ++i) {
+    if (stop_selected[i]) {
+      candidates.push_back({screen[stops[i]->id_], CountChars(stops[i]->name_), false,
+                            bus_count(i)});
+      stop_indices.push_back(i);
+    }
+  }
+
+  const std::vector<bool> keep = CullLabels(candidates, settings);
+  LabelMask mask;
+  mask.terminals.assign(2 * buses.size(), false);
+  mask.stops.assign(stops.size(), false);
+  for (size_t i = 0; i < terminals.size(); ++i) {
+    mask.terminals[terminals[i]] = keep[i];
+  }
+  for (size_t i = 0; i < stop_indices.size(); ++i) {
+    mask.stops[stop_indices[i]] = keep[terminals.size() + i];
+  }
+  return mask;
+}
+
+// Меньше этого куски не делятся между потоками: мелкие задачи дороже
+// склейки
+constexpr size_t MIN_RENDER_CHUNK = 256;
+
+transpot_guide::PackedRTree::Box MakeBox(
+    transpot_guide::detail::Coordinates from,
+    transpot_guide::detail::Coordinates to) {
+  return {std::min(from.lng, to.lng), std::min(from.lat, to.lat),
+          std::max(from.lng, to.lng), std::max(from.lat, to.lat)};
+}
+}  // namespace
+
+bool MapViewport::IsValid() const {
+  switch (kind) {
+    case Kind::WHOLE:
+      return true;
+    case Kind::BBOX:
+      return min.lat < max.lat && min.lng < max.lng;
+    case Kind::TILE:
+      return z >= 0 && z <= MAX_TILE_ZOOM && x >= 0 && y >= 0 &&
+             x < (1 << z) && y < (1 << z);
+  }
+  return false;
+}
 
-  return stops_point;
+std::string MapViewport::GetKey() const {
+  std::ostringstream out;
+  out.precision(17);
+  switch (kind) {
+    case Kind::WHOLE:
+      out << "whole"sv;
+      break;
+    case Kind::BBOX:
+      out << "bbox/"sv << min.lat << '/' << min.lng << '/' << max.lat << '/'
+          << max.lng;
+      break;
+    case Kind::TILE:
+      out << "tile/"sv << z << '/' << x << '/' << y;
+      break;
+  }
+  return out.str();
+}
+
+bool MapQuery::IsValid() const {
+  return viewport.IsValid() &&
+         (!gzip_level ||
+          (*gzip_level >= gzip::MIN_LEVEL && *gzip_level <= gzip::MAX_LEVEL));
 }
 
-std::vector<svg::Text> DrawStopName(const std::deque<Stop*>& stops,
-                                    RenderSettings& settings,
-                                    SphereProjector& projector) {
-  std::vector<svg::Text> stops_name;
-    for (const auto stop : stops) {
-      svg::Text first_text;
-      svg::Text second_text;
-      first_text.SetPosition(projector(stop->coordinates_))
-          .SetOffset(settings.stop_label_offset)
-          .SetFontSize(settings.stop_label_font_size)
-          .SetFontFamily("Verdana"s)
-          .SetData(stop->name_)
-          .SetFillColor("black"s);
-      second_text.SetPosition(projector(stop->coordinates_))
-          .SetOffset(settings.stop_label_offset)
-          .SetFontSize(settings.stop_label_font_size)
-          .SetFontFamily("Verdana"s)
-          .SetData(stop->name_)
-          .SetFillColor(settings.underlayer_color)
-          .SetStrokeColor(settings.underlayer_color)
-          .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-          .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
-          .SetStrokeWidth(settings.underlayer_width);
-      stops_name.push_back(second_text);
-      stops_name.push_back(first_text);
+std::string MapQuery::GetKey() const {
+  std::string key = viewport.GetKey();
+  if (buses) {
+    std::vector<std::string_view> names(buses->begin(), buses->end());
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    key += "/buses"sv;
+    for (std::string_view name : names) {
+      // Длина перед именем, чтобы имена с разделителями не склеивались
+      key += '/' + std::to_string(name.size()) + ':';
+      key += name;
     }
-  return stops_name;
+  }
+  if (gzip_level) {
+    key += "/gzip"sv;
+    key += std::to_string(*gzip_level);
+  }
+  return key;
+}
+
+MapRenderer::MapRenderer(RenderSettings settings, ThreadPool* pool)
+    : pool_(pool) {
+  SetSettings(std::move(settings));
 }
 
-json::Node GetMapOfRoad(::transpot_guide::TransportCatalogue& transport_catalog,
-                        RenderSettings& settings, int id) {
-  auto raw_stops = transport_catalog.GetStops();
-  std::deque<Stop*> stops;
-  for (auto stop : raw_stops) {
-    if (!transport_catalog.GetBusofStop(stop->name_).empty()) {
-      stops.push_back(stop);
+void MapRenderer::SetSettings(RenderSettings settings) {
+  settings_ = std::move(settings);
+  settings_fingerprint_ = ComputeFingerprint(settings_);
+  // Проекция и куски SVG в сцене зависят от настроек
+  scene_.reset();
+}
+
+const RenderSettings& MapRenderer::GetSettings() const { return settings_; }
+
+void MapRenderer::CheckCatalog(
+    const ::transpot_guide::TransportCatalogue& transport_catalog) {
+  if (cached_catalog_ != &transport_catalog ||
+      cached_revision_ != transport_catalog.GetRevision()) {
+    cache_.clear();
+    cache_index_.clear();
+    scene_.reset();
+    cached_catalog_ = &transport_catalog;
+    cached_revision_ = transport_catalog.GetRevision();
+  }
+}
+
+std::shared_ptr<const std::string> MapRenderer::GetEscapedMap(
+    const ::transpot_guide::TransportCatalogue& transport_catalog,
+    const MapQuery& query) {
+  const std::string key =
+      std::to_string(settings_fingerprint_) + '/' + query.GetKey();
+  Scene* scene = nullptr;
+  Selection selection;
+  MissingFragments missing;
+  {
+    std::lock_guard guard(mutex_);
+    CheckCatalog(transport_catalog);
+    auto found = cache_index_.find(key);
+    if (found != cache_index_.end()) {
+      cache_.splice(cache_.begin(), cache_, found->second);
+      return found->second->second;
+    }
+    Scene& current = GetScene(transport_catalog);
+    selection = Select(current, query);
+    if (query.viewport.kind == MapViewport::Kind::WHOLE) {
+      missing = FindMissingFragments(current, selection);
+    }
+    scene = &current;
+  }
+  // Куски рисуются вне блокировки: пул может быть занят и вызывающим,
+  // его задачи тоже ждут mutex_
+  if (!missing.buses.empty() || !missing.stops.empty()) {
+    FillFragments(*scene, missing);
+    std::lock_guard guard(mutex_);
+    PublishFragments(*scene, missing);
+  }
+
+  // Рисуется без блокировки: другие потоки в это время могут только
+  // переносить в сцену куски, не выбранные здесь
+  auto map = std::make_shared<std::string>();
+  auto render = [&](std::ostream& output) {
+    if (query.viewport.kind == MapViewport::Kind::WHOLE) {
+      RenderFragments(*scene, selection, output);
+    } else {
+      RenderViewport(*scene, selection, query.viewport, output);
+    }
+    output.flush();
+  };
+  // Экранирование или сжатие идёт прямо при отрисовке, без копии
+  // исходного SVG. Base64 экранировать не нужно.
+  if (query.gzip_level) {
+    base64::Base64Buffer base64(*map);
+    std::ostream encoded(&base64);
+    gzip::GzipBuffer gzip(encoded, *query.gzip_level);
+    std::ostream output(&gzip);
+    render(output);
+    gzip.Finish();
+    encoded.flush();
+    base64.Finish();
+  } else {
+    json::EscapingBuffer buffer(*map);
+    std::ostream output(&buffer);
+    render(output);
+  }
+
+  std::lock_guard guard(mutex_);
+  auto found = cache_index_.find(key);
+  if (found != cache_index_.end()) {
+    // Ту же карту успел нарисовать другой поток
+    cache_.splice(cache_.begin(), cache_, found->second);
+    return found->second->second;
+  }
+  if (cache_.size() >= std::max<size_t>(settings_.map_cache_size, 1)) {
+    cache_index_.erase(cache_.back().first);
+    cache_.pop_back();
+  }
+  cache_.emplace_front(key, std::move(map));
+  cache_index_[key] = cache_.begin();
+  return cache_.front().second;
+}
+
+MapRenderer::Scene& MapRenderer::GetScene(
+    const ::transpot_guide::TransportCatalogue& transport_catalog) {
+  CheckCatalog(transport_catalog);
+  if (scene_) {
+    return *scene_;
+  }
+  Scene& scene = scene_.emplace();
+  auto by_name = [](const auto* left, const auto* right) {
+    return left->name_ < right->name_;
+  };
+  for (const Bus& bus : transport_catalog.GetBusList()) {
+    if (!bus.route_stops_.empty()) {
+      scene.buses.push_back(&bus);
+      scene.max_bus_name = std::max(scene.max_bus_name, CountChars(bus.name_));
+    }
+  }
+  std::sort(scene.buses.begin(), scene.buses.end(), by_name);
+  for (size_t i = 0; i < scene.buses.size(); ++i) {
+    scene.bus_indices[scene.buses[i]->name_] = i;
+  }
+  scene.bus_fragments.resize(scene.buses.size());
+  for (const Stop& stop : transport_catalog.GetStopList()) {
+    if (!transport_catalog.GetBusesOfStop(stop.name_).empty()) {
+      scene.stops.push_back(&stop);
+      scene.max_stop_name =
+          std::max(scene.max_stop_name, CountChars(stop.name_));
+    }
+  }
+  std::sort(scene.stops.begin(), scene.stops.end(), by_name);
+  for (size_t i = 0; i < scene.stops.size(); ++i) {
+    scene.stop_bus_counts.push_back(
+        transport_catalog.GetBusesOfStop(scene.stops[i]->name_).size());
+    scene.stop_indices[scene.stops[i]] = i;
+  }
+  scene.stop_fragments.resize(scene.stops.size());
+
+  StopScreen screen =
+      ProjectStops(transport_catalog.GetStopList(), scene.stops, settings_);
+  scene.projector = screen.projector;
+  scene.screen = std::move(screen.points);
+  std::vector<transpot_guide::PackedRTree::Box> stop_boxes;
+  for (const Stop* stop : scene.stops) {
+    const auto coordinates = stop->GetCoordinates();
+    stop_boxes.push_back(MakeBox(coordinates, coordinates));
+  }
+  scene.stop_tree = transpot_guide::PackedRTree(stop_boxes);
+
+  // Обратный путь некольцевого маршрута повторяет прямой,
+  // поэтому в индекс идут только отрезки прямого пути
+  std::vector<transpot_guide::PackedRTree::Box> segment_boxes;
+  std::vector<transpot_guide::PackedRTree::Box> terminal_boxes;
+  for (uint32_t i = 0; i < scene.buses.size(); ++i) {
+    const auto& route = scene.buses[i]->route_stops_;
+    if (route.size() == 1) {
+      scene.segments.push_back({i, 0});
+      segment_boxes.push_back(MakeBox(route[0]->GetCoordinates(),
+                                      route[0]->GetCoordinates()));
+    }
+    for (uint32_t j = 0; j + 1 < route.size(); ++j) {
+      scene.segments.push_back({i, j});
+      segment_boxes.push_back(MakeBox(route[j]->GetCoordinates(),
+                                      route[j + 1]->GetCoordinates()));
     }
+    scene.terminals.push_back({i, 0});
+    if (HasSecondTerminal(*scene.buses[i])) {
+      scene.terminals.push_back({i, static_cast<uint32_t>(route.size() - 1)});
+    }
+  }
+  for (const auto& [bus, position] : scene.terminals) {
+    const auto coordinates =
+        scene.buses[bus]->route_stops_[position]->GetCoordinates();
+    terminal_boxes.push_back(MakeBox(coordinates, coordinates));
   }
+  scene.segment_tree = transpot_guide::PackedRTree(segment_boxes);
+  scene.terminal_tree = transpot_guide::PackedRTree(terminal_boxes);
+  return scene;
+}
 
-  SphereProjector projector = CreatorSphereProjector(stops, settings);
+MapRenderer::Selection MapRenderer::Select(const Scene& scene,
+                                           const MapQuery& query) const {
+  Selection selection;
+  selection.buses.assign(scene.buses.size(), !query.buses);
+  selection.stops.assign(scene.stops.size(), !query.buses);
+  if (!query.buses) {
+    return selection;
+  }
+  for (const std::string& name : *query.buses) {
+    auto found = scene.bus_indices.find(name);
+    if (found == scene.bus_indices.end()) {
+      continue;
+    }
+    selection.buses[found->second] = true;
+    for (const Stop* stop : scene.buses[found->second]->route_stops_) {
+      selection.stops[scene.stop_indices.at(stop)] = true;
+    }
+  }
+  return selection;
+}
 
+MapRenderer::MissingFragments MapRenderer::FindMissingFragments(
+    const Scene& scene, const Selection& selection) const {
+  MissingFragments missing;
+  for (size_t i = 0; i < scene.buses.size(); ++i) {
+    if (selection.buses[i] && !scene.bus_fragments[i].ready) {
+      missing.buses.emplace_back(i, Scene::BusFragments{});
+    }
+  }
+  for (size_t i = 0; i < scene.stops.size(); ++i) {
+    if (selection.stops[i] && !scene.stop_fragments[i].ready) {
+      missing.stops.emplace_back(i, Scene::StopFragments{});
+    }
+  }
+  return missing;
+}
 
-  auto buses = transport_catalog.GetBus();
-  std::sort(buses.begin(), buses.end(),
-            [](auto& left, auto& right) {
-    return std::lexicographical_compare(left->name_.begin(), left->name_.end(), right->name_.begin(), right->name_.end());
-    /*return left->name_ < right->name_;*/ });
+void MapRenderer::FillFragments(const Scene& scene,
+                                MissingFragments& missing) const {
+  auto& buses = missing.buses;
+  auto& stops = missing.stops;
+  const MapStyles styles = PrepareStyles(settings_);
+  const std::vector<svg::Point>& screen = scene.screen;
+  // Каждый кусок пишется в свою строку, поэтому куски можно рисовать
+  // в несколько потоков
+  auto fill = [&](size_t task) {
+    std::vector<svg::Text> texts;
+    if (task < buses.size()) {
+      const size_t i = buses[task].first;
+      const Bus& bus = *scene.buses[i];
+      auto& fragments = buses[task].second;
+      if (!settings_.shared_segments) {
+        svg::Writer out(fragments.line);
+        std::vector<svg::Point> points;
+        MakeRouteLine(bus, i, screen, settings_, styles, points)
+            .Render(svg::Document::GetObjectContext(out));
+      }
+      const size_t terminal_count = HasSecondTerminal(bus) ? 2 : 1;
+      for (size_t k = 0; k < terminal_count; ++k) {
+        const Stop* stop =
+            k == 0 ? bus.route_stops_.front() : bus.route_stops_.back();
+        AddBusLabel(texts, screen[stop->id_], bus, settings_, styles, i);
+        svg::Writer out(fragments.labels[k]);
+        for (const svg::Text& text : texts) {
+          text.Render(svg::Document::GetObjectContext(out));
+        }
+        texts.clear();
+      }
+    } else {
+      const size_t i = stops[task - buses.size()].first;
+      const Stop& stop = *scene.stops[i];
+      auto& fragments = stops[task - buses.size()].second;
+      {
+        svg::Writer out(fragments.point);
+        MakeStopPoint(screen[stop.id_], settings_, styles)
+            .Render(svg::Document::GetObjectContext(out));
+      }
+      AddStopLabel(texts, screen[stop.id_], stop, settings_, styles);
+      svg::Writer out(fragments.label);
+      for (const svg::Text& text : texts) {
+        text.Render(svg::Document::GetObjectContext(out));
+      }
+    }
+  };
+  const size_t task_count = buses.size() + stops.size();
+  if (pool_ && pool_->GetThreadCount() > 1 && task_count > MIN_RENDER_CHUNK) {
+    pool_->ParallelFor(0, task_count, fill, MIN_RENDER_CHUNK);
+  } else {
+    for (size_t task = 0; task < task_count; ++task) {
+      fill(task);
+    }
+  }
+}
 
-  std::vector<svg::Polyline> lines = DrawLineofRoad(buses, settings, projector);
-  std::vector<svg::Text> NamesOfRoad =
-      DrawNameOfRoad(buses, settings, projector);
+void MapRenderer::PublishFragments(Scene& scene, MissingFragments& missing) {
+  // Кусок мог уже перенести другой поток, его читают без блокировки
+  for (auto& [i, fragments] : missing.buses) {
+    if (!scene.bus_fragments[i].ready) {
+      scene.bus_fragments[i] = std::move(fragments);
+      scene.bus_fragments[i].ready = true;
+    }
+  }
+  for (auto& [i, fragments] : missing.stops) {
+    if (!scene.stop_fragments[i].ready) {
+      scene.stop_fragments[i] = std::move(fragments);
+      scene.stop_fragments[i].ready = true;
+    }
+  }
+}
 
-  std::sort(stops.begin(), stops.end(),
-                [](auto left, auto right) {
+void MapRenderer::RenderFragments(const Scene& scene,
+                                  const Selection& selection,
+                                  std::ostream& output) const {
+  std::optional<LabelMask> labels;
+  if (settings_.label_culling) {
+    labels = ChooseLabels(
+        scene.buses, selection.buses, scene.stops, selection.stops,
+        [&scene](size_t i) { return scene.stop_bus_counts[i]; },
+        scene.screen, settings_);
+  }
 
-    return std::lexicographical_compare(left->name_.begin(), left->name_.end(), right->name_.begin(), right->name_.end());
-        /*return left->name_ < right->name_;*/ });
+  svg::Writer out(output);
+  svg::Document::RenderBegin(out, settings_.shared_segments);
+  if (settings_.shared_segments) {
+    // Общие участки зависят от набора автобусов, поэтому не кэшируются
+    RenderSharedLines(scene.buses, selection.buses, scene.screen, settings_,
+                      PrepareStyles(settings_),
+                      svg::Document::GetObjectContext(out));
+  } else {
+    for (size_t i = 0; i < scene.buses.size(); ++i) {
+      if (selection.buses[i]) {
+        out << scene.bus_fragments[i].line;
+      }
+    }
+  }
+  for (size_t i = 0; i < scene.buses.size(); ++i) {
+    if (!selection.buses[i]) {
+      continue;
+    }
+    for (size_t k = 0; k < 2; ++k) {
+      if (!labels || labels->terminals[2 * i + k]) {
+        out << scene.bus_fragments[i].labels[k];
+      }
+    }
+  }
+  for (size_t i = 0; i < scene.stops.size(); ++i) {
+    if (selection.stops[i]) {
+      out << scene.stop_fragments[i].point;
+    }
+  }
+  for (size_t i = 0; i < scene.stops.size(); ++i) {
+    if (selection.stops[i] && (!labels || labels->stops[i])) {
+      out << scene.stop_fragments[i].label;
+    }
+  }
+  svg::Document::RenderEnd(out);
+}
 
-  std::vector<svg::Circle> stop_points = DrawStop(stops, settings, projector);
+void MapRenderer::RenderViewport(const Scene& scene,
+                                 const Selection& selection,
+                                 const MapViewport& viewport,
+                                 std::ostream& output) const {
+  SphereProjector projector = *scene.projector;
+  if (viewport.kind == MapViewport::Kind::TILE) {
+    const double scale = static_cast<double>(1 << viewport.z);
+    projector.Zoom(scale, {viewport.x * settings_.width,
+                           viewport.y * settings_.height});
+  } else {
+    const transpot_guide::detail::Coordinates corners[] = {viewport.min,
+                                                           viewport.max};
+    projector = SphereProjector(std::begin(corners), std::end(corners),
+                                settings_.width, settings_.height,
+                                settings_.padding);
+  }
 
-  std::vector<svg::Text> stop_names = DrawStopName(stops, settings, projector);
+  // Холст, расширенный на margin пикселей, в градусах
+  auto canvas = [&](double margin) {
+    return MakeBox(
+        projector.Unproject({-margin, -margin}),
+        projector.Unproject({settings_.width + margin,
+                             settings_.height + margin}));
+  };
+  // selected(index) — попадает ли найденный объект на карту
+  auto search = [](const transpot_guide::PackedRTree& tree,
+                   const transpot_guide::PackedRTree::Box& box,
+                   auto selected) {
+    std::vector<size_t> found;
+    tree.Search(box, [&](size_t index) {
+      if (selected(index)) {
+        found.push_back(index);
+      }
+    });
+    // Порядок отрисовки тот же, что у всей карты
+    std::sort(found.begin(), found.end());
+    return found;
+  };
 
+  const MapStyles styles = PrepareStyles(settings_);
   svg::Document doc;
 
-  for (auto& line : lines) {
+  // Подряд идущие видимые отрезки автобуса рисуются одной линией
+  const std::vector<size_t> segments =
+      search(scene.segment_tree, canvas(settings_.line_width / 2),
+             [&](size_t index) {
+               return selection.buses[scene.segments[index].first];
+             });
+  std::vector<svg::Point> points;
+  for (size_t i = 0; i < segments.size();) {
+    const auto [bus, first] = scene.segments[segments[i]];
+    const auto& route = scene.buses[bus]->route_stops_;
+    svg::Polyline line = MakeBusLine(styles, bus);
+    points.push_back(projector(route[first]->GetCoordinates()));
+    uint32_t last = first;
+    for (; i < segments.size() && scene.segments[segments[i]].first == bus &&
+           scene.segments[segments[i]].second == last;
+         ++i, ++last) {
+      if (last + 1 < route.size()) {
+        points.push_back(projector(route[last + 1]->GetCoordinates()));
+      }
+    }
+    AddLinePoints(line, points, settings_);
     doc.Add(std::move(line));
   }
 
-  for (auto& name : NamesOfRoad) {
-    doc.Add(std::move(name));
+  auto terminal_selected = [&](size_t index) {
+    return selection.buses[scene.terminals[index].first];
+  };
+  auto stop_selected = [&](size_t index) { return selection.stops[index]; };
+  const std::vector<size_t> terminals = search(
+      scene.terminal_tree,
+      canvas(GetLabelMargin(settings_.bus_label_offset,
+                            settings_.bus_label_front_size, scene.max_bus_name,
+                            settings_.underlayer_width)),
+      terminal_selected);
+  const std::vector<size_t> stops =
+      search(scene.stop_tree, canvas(settings_.stop_radius), stop_selected);
+  const std::vector<size_t> stop_labels = search(
+      scene.stop_tree,
+      canvas(GetLabelMargin(settings_.stop_label_offset,
+                            settings_.stop_label_font_size,
+                            scene.max_stop_name, settings_.underlayer_width)),
+      stop_selected);
+  auto terminal_point = [&](size_t index) {
+    const auto [bus, position] = scene.terminals[index];
+    return projector(
+        scene.buses[bus]->route_stops_[position]->GetCoordinates());
+  };
+
+  // Отбор идёт среди подписей, попавших в область
+  std::vector<bool> keep;
+  if (settings_.label_culling) {
+    std::vector<LabelCandidate> candidates;
+    for (size_t index : terminals) {
+      const Bus& bus = *scene.buses[scene.terminals[index].first];
+      candidates.push_back(
+          {terminal_point(index), CountChars(bus.name_), true, 0});
+    }
+    for (size_t index : stop_labels) {
+      candidates.push_back({projector(scene.stops[index]->GetCoordinates()),
+                            CountChars(scene.stops[index]->name_), false,
+                            scene.stop_bus_counts[index]});
+    }
+    keep = CullLabels(candidates, settings_);
+  } else {
+    keep.assign(terminals.size() + stop_labels.size(), true);
   }
 
-  for (auto& point : stop_points) {
-    doc.Add(std::move(point));
+  std::vector<svg::Text> texts;
+  for (size_t i = 0; i < terminals.size(); ++i) {
+    if (keep[i]) {
+      const uint32_t bus = scene.terminals[terminals[i]].first;
+      AddBusLabel(texts, terminal_point(terminals[i]), *scene.buses[bus],
+                  settings_, styles, bus);
+    }
+  }
+  for (auto& text : texts) {
+    doc.Add(std::move(text));
   }
 
-  for (auto& name : stop_names) {
-    doc.Add(std::move(name));
+  for (size_t index : stops) {
+    doc.Add(MakeStopPoint(projector(scene.stops[index]->GetCoordinates()),
+                          settings_, styles));
   }
 
-//  doc.Render(std::cout);
-  //
-  //
-  //  return json::Node();
+  texts.clear();
+  for (size_t i = 0; i < stop_labels.size(); ++i) {
+    if (keep[terminals.size() + i]) {
+      const Stop& stop = *scene.stops[stop_labels[i]];
+      AddStopLabel(texts, projector(stop.GetCoordinates()), stop, settings_,
+                   styles);
+    }
+  }
+  for (auto& text : texts) {
+    doc.Add(std::move(text));
+  }
 
-  std::stringstream svg_data;
-  doc.Render(svg_data);
-  json::Dict out;
-  out.insert({"request_id", json::Node(id)});
-  out.insert({"map", json::Node(svg_data.str())});
-  return json::Node(out);
+  doc.Render(output);
 }
 
+void PrintMapOfRoad(
+    const ::transpot_guide::TransportCatalogue& transport_catalog,
+    MapRenderer& renderer, const MapQuery& query, int id,
+    std::ostream& output) {
+  // Тот же вид, что у json::Dict {"map", "request_id"}; сжатая карта
+  // отдаётся в "map_svgz"
+  output << (query.gzip_level ? "{\"map_svgz\": \""sv : "{\"map\": \""sv);
+  const auto map = renderer.GetEscapedMap(transport_catalog, query);
+  output.write(map->data(), map->size());
+  output << "\", \"request_id\": "sv << id << " }"sv;
+}
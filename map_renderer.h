@@ -3,13 +3,25 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 #include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include "svg.h"
 #include "geo.h"
+#include "base64.h"
 #include "domain.h"
+#include "gzip.h"
 #include "json.h"
 #include "transport_catalogue.h"
+#include "packed_rtree.h"
+#include "thread_pool.h"
 
 inline const double EPSILON = 1e-6;
 
@@ -26,6 +38,46 @@ struct RenderSettings {
   svg::Color underlayer_color;
   double underlayer_width;
   std::vector<svg::Color> color_palette;
+  // Допуск упрощения линий маршрутов в пикселях, 0 — без упрощения
+  double lod_tolerance = 0;
+  // Не рисовать подписи, наложившиеся на более важные
+  bool label_culling = false;
+  // Участки, общие для нескольких автобусов, описывать один раз и рисовать
+  // сдвинутыми параллельными копиями; только для карты всего города
+  bool shared_segments = false;
+  // Сколько отрисованных карт и тайлов держать в кэше
+  size_t map_cache_size = 64;
+};
+
+// Область карты в запросе Map. Тайлы считаются от карты всего города:
+// на уровне z она делится на 2^z x 2^z тайлов размером width x height.
+struct MapViewport {
+  enum class Kind { WHOLE, BBOX, TILE };
+
+  Kind kind = Kind::WHOLE;
+  transpot_guide::detail::Coordinates min{0, 0};
+  transpot_guide::detail::Coordinates max{0, 0};
+  int z = 0;
+  int x = 0;
+  int y = 0;
+
+  bool IsValid() const;
+  // Ключ области в кэше карт
+  std::string GetKey() const;
+};
+
+// Запрос карты: область и, если задан, список автобусов. Без списка
+// рисуются все автобусы, со списком — только они и их остановки.
+// Проекция и цвета всегда те же, что у карты всего города.
+// С уровнем gzip_level карта отдаётся как SVGZ: gzip, затем base64.
+struct MapQuery {
+  MapViewport viewport;
+  std::optional<std::vector<std::string>> buses;
+  std::optional<int> gzip_level;
+
+  bool IsValid() const;
+  // Ключ запроса в кэше карт, от порядка автобусов не зависит
+  std::string GetKey() const;
 };
 
 
@@ -33,25 +85,31 @@ bool IsZero(double value);
 
 class SphereProjector {
  public:
+  // Границы координат: широта и долгота
+  struct Bounds {
+    double min_lat;
+    double max_lat;
+    double min_lon;
+    double max_lon;
+  };
+
   template <typename PointInputIt>
   SphereProjector(PointInputIt points_begin, PointInputIt points_end,
                   double max_width, double max_height, double padding)
+      : SphereProjector(GetBounds(points_begin, points_end), max_width,
+                        max_height, padding) {}
+
+  // Проекция по готовым границам; nullopt — точек нет
+  SphereProjector(std::optional<Bounds> bounds, double max_width,
+                  double max_height, double padding)
       : padding_(padding) {
-    if (points_begin == points_end) {
+    if (!bounds) {
       return;
     }
-
-    const auto [left_it, right_it] = std::minmax_element(
-        points_begin, points_end,
-        [](auto lhs, auto rhs) { return lhs.lng < rhs.lng; });
-    min_lon_ = left_it->lng;
-    const double max_lon = right_it->lng;
-
-    const auto [bottom_it, top_it] = std::minmax_element(
-        points_begin, points_end,
-        [](auto lhs, auto rhs) { return lhs.lat < rhs.lat; });
-    const double min_lat = bottom_it->lat;
-    max_lat_ = top_it->lat;
+    min_lon_ = bounds->min_lon;
+    const double max_lon = bounds->max_lon;
+    const double min_lat = bounds->min_lat;
+    max_lat_ = bounds->max_lat;
 
     std::optional<double> width_zoom;
     if (!IsZero(max_lon - min_lon_)) {
@@ -72,9 +130,57 @@ class SphereProjector {
     }
   }
 
+  template <typename PointInputIt>
+  static std::optional<Bounds> GetBounds(PointInputIt points_begin,
+                                         PointInputIt points_end) {
+    if (points_begin == points_end) {
+      return std::nullopt;
+    }
+    const auto [left_it, right_it] = std::minmax_element(
+        points_begin, points_end,
+        [](auto lhs, auto rhs) { return lhs.lng < rhs.lng; });
+    const auto [bottom_it, top_it] = std::minmax_element(
+        points_begin, points_end,
+        [](auto lhs, auto rhs) { return lhs.lat < rhs.lat; });
+    return Bounds{bottom_it->lat, top_it->lat, left_it->lng, right_it->lng};
+  }
+
+  // То же, что operator() для каждой точки, по плотным массивам широт
+  // и долгот; цикл без ветвлений и векторизуется компилятором
+  void ProjectBatch(const double* lats, const double* lngs, size_t count,
+                    svg::Point* points) const {
+    const double min_lon = min_lon_;
+    const double max_lat = max_lat_;
+    const double zoom = zoom_coeff_;
+    const double padding = padding_;
+    const double shift_x = shift_.x;
+    const double shift_y = shift_.y;
+    for (size_t i = 0; i < count; ++i) {
+      points[i].x = (lngs[i] - min_lon) * zoom + padding - shift_x;
+      points[i].y = (max_lat - lats[i]) * zoom + padding - shift_y;
+    }
+  }
+
   svg::Point operator()(transpot_guide::detail::Coordinates coords) const {
-    return {(coords.lng - min_lon_) * zoom_coeff_ + padding_,
-            (max_lat_ - coords.lat) * zoom_coeff_ + padding_};
+    return {(coords.lng - min_lon_) * zoom_coeff_ + padding_ - shift_.x,
+            (max_lat_ - coords.lat) * zoom_coeff_ + padding_ - shift_.y};
+  }
+
+  // Увеличивает картинку в scale раз и сдвигает её на shift пикселей
+  // (уже увеличенных) влево и вверх
+  void Zoom(double scale, svg::Point shift) {
+    zoom_coeff_ *= scale;
+    padding_ *= scale;
+    shift_ = shift;
+  }
+
+  // Обратное преобразование точки холста в координаты
+  transpot_guide::detail::Coordinates Unproject(svg::Point point) const {
+    if (IsZero(zoom_coeff_)) {
+      return {max_lat_, min_lon_};
+    }
+    return {max_lat_ - (point.y + shift_.y - padding_) / zoom_coeff_,
+            (point.x + shift_.x - padding_) / zoom_coeff_ + min_lon_};
   }
 
  private:
@@ -82,18 +188,107 @@ class SphereProjector {
   double min_lon_ = 0;
   double max_lat_ = 0;
   double zoom_coeff_ = 0;
+  svg::Point shift_{0, 0};
 };
 
 
-SphereProjector CreatorSphereProjector(std::deque<Stop*>& stops, RenderSettings& settings);
+// Отрисованные карты хранятся до изменения каталога: ключ кэша — отпечаток
+// настроек и область карты, весь кэш сбрасывается при смене ревизии
+// каталога. Кэш ограничен map_cache_size, вытесняется давно не нужное.
+// GetEscapedMap можно вызывать из нескольких потоков; SetSettings и
+// изменение каталога — только когда карты не рисуются.
+class MapRenderer {
+ public:
+  // pool — для заполнения кусков SVG всей карты в несколько потоков
+  explicit MapRenderer(RenderSettings settings, ThreadPool* pool = nullptr);
+
+  void SetSettings(RenderSettings settings);
 
-std::vector<svg::Polyline> DrawLineofRoad(const Bus* bus, RenderSettings& settings, SphereProjector& projector);
+  const RenderSettings& GetSettings() const;
 
-std::vector<svg::Text> DrawNameOfRoad(const std::deque<Bus*>& buses, RenderSettings& settings, SphereProjector& projector);
+  // SVG карты, уже экранированный для строки JSON (без кавычек), или
+  // SVGZ в base64, если в запросе задан gzip_level.
+  // Повторный вызов без изменений каталога и настроек отдаёт готовую строку.
+  std::shared_ptr<const std::string> GetEscapedMap(const ::transpot_guide::TransportCatalogue& transport_catalog, const MapQuery& query = {});
 
-std::vector<svg::Circle> DrawStop(const std::deque<Stop*>& stops, RenderSettings& settings, SphereProjector& projector);
+ private:
+  // Всё, что нужно для отрисовки части карты: объекты в порядке отрисовки
+  // всей карты и R-деревья по ним в градусах (x — долгота, y — широта)
+  struct Scene {
+    std::vector<const Bus*> buses;  // по имени, только с остановками
+    std::vector<const Stop*> stops;  // по имени, только с автобусами
+    std::vector<size_t> stop_bus_counts;  // число автобусов у stops[i]
+    std::optional<SphereProjector> projector;  // проекция всей карты
+    std::vector<svg::Point> screen;  // по Stop::id_, в проекции всей карты
+    // Отрезки прямого пути: номер автобуса и номер первой остановки.
+    // У автобуса из одной остановки — один вырожденный отрезок.
+    std::vector<std::pair<uint32_t, uint32_t>> segments;
+    // Конечные с названиями автобусов: номер автобуса и номер остановки
+    std::vector<std::pair<uint32_t, uint32_t>> terminals;
+    transpot_guide::PackedRTree segment_tree;
+    transpot_guide::PackedRTree stop_tree;
+    transpot_guide::PackedRTree terminal_tree;
+    size_t max_bus_name = 0;  // в символах
+    size_t max_stop_name = 0;
+    std::unordered_map<std::string_view, size_t> bus_indices;
+    std::unordered_map<const Stop*, size_t> stop_indices;
 
-std::vector<svg::Text> DrawStopName(const std::deque<Stop*>& stops, RenderSettings& settings, SphereProjector& projector);
+    // Готовые куски SVG всей карты, заполняются по мере надобности.
+    // У автобуса — линия и подписи конечных (вторая может быть пустой).
+    struct BusFragments {
+      bool ready = false;
+      std::string line;
+      std::string labels[2];
+    };
+    struct StopFragments {
+      bool ready = false;
+      std::string point;
+      std::string label;
+    };
+    std::vector<BusFragments> bus_fragments;
+    std::vector<StopFragments> stop_fragments;
+  };
 
-json::Node GetMapOfRoad(::transpot_guide::TransportCatalogue& transport_catalog, RenderSettings& settings, int id);
+  // Какие автобусы и остановки сцены попадают на карту
+  struct Selection {
+    std::vector<bool> buses;
+    std::vector<bool> stops;
+  };
+
+  // Незаполненные куски сцены, нужные выборке, с номерами в сцене.
+  // Рисуются без блокировки и переносятся в сцену под ней.
+  struct MissingFragments {
+    std::vector<std::pair<size_t, Scene::BusFragments>> buses;
+    std::vector<std::pair<size_t, Scene::StopFragments>> stops;
+  };
+
+  using CacheList =
+      std::list<std::pair<std::string, std::shared_ptr<const std::string>>>;
+
+  void CheckCatalog(const ::transpot_guide::TransportCatalogue& transport_catalog);
+  Scene& GetScene(const ::transpot_guide::TransportCatalogue& transport_catalog);
+  Selection Select(const Scene& scene, const MapQuery& query) const;
+  MissingFragments FindMissingFragments(const Scene& scene, const Selection& selection) const;
+  void FillFragments(const Scene& scene, MissingFragments& missing) const;
+  static void PublishFragments(Scene& scene, MissingFragments& missing);
+  // Куски должны быть перенесены в сцену PublishFragments
+  void RenderFragments(const Scene& scene, const Selection& selection, std::ostream& output) const;
+  void RenderViewport(const Scene& scene, const Selection& selection, const MapViewport& viewport, std::ostream& output) const;
+
+  RenderSettings settings_;
+  ThreadPool* pool_ = nullptr;
+  uint64_t settings_fingerprint_ = 0;
+  const ::transpot_guide::TransportCatalogue* cached_catalog_ = nullptr;
+  uint64_t cached_revision_ = 0;
+  // Защищает кэш, создание сцены и флаги готовности кусков. Куски и сама
+  // карта рисуются без блокировки: готовый кусок больше не меняется
+  std::mutex mutex_;
+  std::optional<Scene> scene_;
+  // Начало списка — последние запрошенные карты
+  CacheList cache_;
+  std::unordered_map<std::string, CacheList::iterator> cache_index_;
+};
 
+// Печатает ответ на запрос Map в output, не собирая json::Node.
+// Запрос должен быть корректным (MapQuery::IsValid).
+void PrintMapOfRoad(const ::transpot_guide::TransportCatalogue& transport_catalog, MapRenderer& renderer, const MapQuery& query, int id, std::ostream& output);
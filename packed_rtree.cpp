@@ -0,0 +1,60 @@
+#include "packed_rtree.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace transpot_guide {
+
+PackedRTree::PackedRTree(const std::vector<Box>& boxes) {
+  items_.resize(boxes.size());
+  for (uint32_t i = 0; i < items_.size(); ++i) {
+    items_[i] = i;
+  }
+  auto center_x = [&](uint32_t i) { return boxes[i].min_x + boxes[i].max_x; };
+  auto center_y = [&](uint32_t i) { return boxes[i].min_y + boxes[i].max_y; };
+
+  std::sort(items_.begin(), items_.end(), [&](uint32_t lhs, uint32_t rhs) {
+    return center_x(lhs) < center_x(rhs);
+  });
+  const size_t leaf_count = (items_.size() + NODE_SIZE - 1) / NODE_SIZE;
+  const auto slice_count = std::max<size_t>(
+      1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(leaf_count)))));
+  const size_t slice_size =
+      std::max<size_t>(1, (leaf_count + slice_count - 1) / slice_count) *
+      NODE_SIZE;
+  for (size_t begin = 0; begin < items_.size(); begin += slice_size) {
+    const size_t end = std::min(items_.size(), begin + slice_size);
+    std::sort(items_.begin() + begin, items_.begin() + end,
+              [&](uint32_t lhs, uint32_t rhs) {
+                return center_y(lhs) < center_y(rhs);
+              });
+  }
+
+  std::vector<Box> leaves;
+  leaves.reserve(items_.size());
+  for (uint32_t item : items_) {
+    leaves.push_back(boxes[item]);
+  }
+  levels_.push_back(std::move(leaves));
+  while (levels_.back().size() > 1) {
+    const std::vector<Box>& children = levels_.back();
+    std::vector<Box> parents;
+    parents.reserve((children.size() + NODE_SIZE - 1) / NODE_SIZE);
+    for (size_t i = 0; i < children.size(); i += NODE_SIZE) {
+      Box box = children[i];
+      for (size_t j = i + 1; j < std::min(children.size(), i + NODE_SIZE);
+           ++j) {
+        box.min_x = std::min(box.min_x, children[j].min_x);
+        box.min_y = std::min(box.min_y, children[j].min_y);
+        box.max_x = std::max(box.max_x, children[j].max_x);
+        box.max_y = std::max(box.max_y, children[j].max_y);
+      }
+      parents.push_back(box);
+    }
+    levels_.push_back(std::move(parents));
+  }
+}
+
+size_t PackedRTree::GetSize() const { return items_.size(); }
+
+}  // namespace transpot_guide
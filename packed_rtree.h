@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace transpot_guide {
+
+// Статическое упакованное R-дерево по прямоугольникам.
+// Листья сортируются по STR (полосы по центру x, внутри полосы по центру y)
+// и упаковываются по NODE_SIZE, уровни хранятся массивами без указателей.
+// Поиск возвращает номера прямоугольников в исходном векторе.
+class PackedRTree {
+ public:
+  struct Box {
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+
+    bool Intersects(const Box& other) const {
+      return min_x <= other.max_x && other.min_x <= max_x &&
+             min_y <= other.max_y && other.min_y <= max_y;
+    }
+  };
+
+  PackedRTree() = default;
+  explicit PackedRTree(const std::vector<Box>& boxes);
+
+  // visit(index) для каждого прямоугольника, пересекающего box
+  template <typename Visitor>
+  void Search(const Box& box, Visitor visit) const;
+
+  size_t GetSize() const;
+
+ private:
+  static constexpr size_t NODE_SIZE = 16;
+
+  std::vector<uint32_t> items_;  // номера прямоугольников в порядке листьев
+  // levels_[0] — сами прямоугольники в порядке листьев,
+  // levels_[i + 1][j] охватывает levels_[i][j * NODE_SIZE, (j + 1) * NODE_SIZE)
+  std::vector<std::vector<Box>> levels_;
+};
+
+template <typename Visitor>
+void PackedRTree::Search(const Box& box, Visitor visit) const {
+  if (items_.empty()) {
+    return;
+  }
+  thread_local std::vector<std::pair<size_t, size_t>> stack;  // уровень, узел
+  const size_t stack_base = stack.size();  // visit может искать рекурсивно
+  stack.push_back({levels_.size() - 1, 0});
+  while (stack.size() > stack_base) {
+    const auto [level, node] = stack.back();
+    stack.pop_back();
+    if (!levels_[level][node].Intersects(box)) {
+      continue;
+    }
+    if (level == 0) {
+      visit(static_cast<size_t>(items_[node]));
+      continue;
+    }
+    const size_t end = std::min(levels_[level - 1].size(), (node + 1) * NODE_SIZE);
+    for (size_t child = node * NODE_SIZE; child < end; ++child) {
+      stack.push_back({level - 1, child});
+    }
+  }
+}
+
+}  // namespace transpot_guide
@@ -1,8 +1,13 @@
 #include "request_handler.h"
 
 #include <algorithm>
+#include <deque>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -10,7 +15,7 @@
 #include "transport_catalogue.h"
 #include "map_renderer.h"
 
-using namespace std::string_literals;
+using namespace std::literals;
 
 namespace transpot_guide {
 namespace output {
@@ -47,33 +52,401 @@ json::Node GetInfoStop(::transpot_guide::TransportCatalogue& transport_catalog,
     } else {
       out.insert({"buses"s, json::Node(json::Array())});
     }
+    if (transport_catalog.HasWalkingLinks()) {
+      json::Array links_out;
+      for (const WalkingLink& link : transport_catalog.GetWalkingLinks(
+               transport_catalog.FindStop(stop))) {
+        json::Dict link_out;
+        link_out.insert({"stop_name"s, json::Node(link.stop->name_)});
+        link_out.insert({"distance"s, json::Node(link.distance)});
+        links_out.push_back(json::Node(link_out));
+      }
+      out.insert({"walking_links"s, json::Node(links_out)});
+    }
+  }
+
+  return json::Node(out);
+}
+
+json::Node GetJourney(::transpot_guide::TransportCatalogue& transport_catalog,
+                      const TransportRouter* router, const std::string_view from,
+                      const std::string_view to, int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  std::optional<RouteResult> route;
+  if (router && transport_catalog.IsStop(from) && transport_catalog.IsStop(to)) {
+    route = router->BuildRoute(transport_catalog.FindStop(from),
+                               transport_catalog.FindStop(to));
+  }
+  if (!route) {
+    out.insert({"error_message"s, json::Node("not found"s)});
+    return json::Node(out);
+  }
+
+  json::Array items;
+  for (const RouteItem& item : route->items) {
+    json::Dict item_out;
+    if (item.bus == nullptr) {
+      item_out.insert({"type"s, json::Node("Wait"s)});
+      item_out.insert({"stop_name"s, json::Node(item.stop->name_)});
+    } else {
+      item_out.insert({"type"s, json::Node("Bus"s)});
+      item_out.insert({"bus"s, json::Node(item.bus->name_)});
+      item_out.insert({"span_count"s, json::Node(item.span_count)});
+    }
+    item_out.insert({"time"s, json::Node(item.time)});
+    items.push_back(json::Node(item_out));
+  }
+  out.insert({"total_time"s, json::Node(route->total_time)});
+  out.insert({"items"s, json::Node(items)});
+  if (router->GetSettings().report_expansions) {
+    out.insert({"expanded_vertices"s,
+                json::Node(static_cast<int>(route->expanded_vertices))});
+  }
+  return json::Node(out);
+}
+
+json::Node GetIsochrone(::transpot_guide::TransportCatalogue& transport_catalog,
+                        const TransportRouter* router,
+                        const std::string_view from, double time_limit, int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  if (!router || !transport_catalog.IsStop(from)) {
+    out.insert({"error_message"s, json::Node("not found"s)});
+    return json::Node(out);
   }
 
+  thread_local std::vector<ReachableStop> reachable;
+  router->FindReachable(transport_catalog.FindStop(from), time_limit,
+                        reachable);
+  json::Array items;
+  items.reserve(reachable.size());
+  for (const ReachableStop& item : reachable) {
+    json::Dict item_out;
+    item_out.insert({"stop_name"s, json::Node(item.stop->name_)});
+    item_out.insert({"time"s, json::Node(item.time)});
+    items.push_back(json::Node(item_out));
+  }
+  out.insert({"items"s, json::Node(items)});
   return json::Node(out);
 }
 
+json::Node GetTransfers(::transpot_guide::TransportCatalogue& transport_catalog,
+                        const TransferGraph& transfers,
+                        const std::string_view from, const std::string_view to,
+                        int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  std::optional<std::vector<TransferGraph::Transfer>> route;
+  if (transport_catalog.IsStop(from) && transport_catalog.IsStop(to)) {
+    route = transfers.FindRoute(transport_catalog.FindStop(from),
+                                transport_catalog.FindStop(to));
+  }
+  if (!route) {
+    out.insert({"error_message"s, json::Node("not found"s)});
+    return json::Node(out);
+  }
 
+  json::Array items;
+  for (const TransferGraph::Transfer& transfer : *route) {
+    json::Dict item_out;
+    item_out.insert({"bus"s, json::Node(transfer.bus->name_)});
+    item_out.insert({"stop_name"s, json::Node(transfer.stop->name_)});
+    items.push_back(json::Node(item_out));
+  }
+  const int transfer_count = route->empty() ? 0 : route->size() - 1;
+  out.insert({"transfer_count"s, json::Node(transfer_count)});
+  out.insert({"items"s, json::Node(items)});
+  return json::Node(out);
+}
 
-json::Node OutputData(TransportCatalogue& transport_catalog, json::Array query,
-                      RenderSettings& setting) {
-  json::Array out;
-  for (auto& i : query) {
-    if (i.AsMap()["type"s] == "Bus"s) {
-      out.push_back(GetInfoRoute(transport_catalog,
-                                 i.AsMap()["name"].AsString(),
-                                 i.AsMap()["id"].AsInt()));
+json::Node GetMatrix(::transpot_guide::TransportCatalogue& transport_catalog,
+                     const TransportRouter* router, const json::Array& sources,
+                     const json::Array& targets, int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  auto find_stops = [&](const json::Array& names) {
+    std::optional<std::vector<const Stop*>> stops{std::in_place};
+    for (const json::Node& name : names) {
+      if (!transport_catalog.IsStop(name.AsString())) {
+        return std::optional<std::vector<const Stop*>>{};
+      }
+      stops->push_back(transport_catalog.FindStop(name.AsString()));
     }
-    if (i.AsMap()["type"s] == "Map"s) {
-      out.push_back(GetMapOfRoad(transport_catalog, setting, i.AsMap()["id"].AsInt()));
+    return stops;
+  };
+  const auto from = find_stops(sources);
+  const auto to = find_stops(targets);
+  if (!router || !from || !to) {
+    out.insert({"error_message"s, json::Node("not found"s)});
+    return json::Node(out);
+  }
+
+  const auto times = router->ComputeMatrix(*from, *to);
+  json::Array rows;
+  rows.reserve(from->size());
+  for (size_t i = 0; i < from->size(); ++i) {
+    json::Array row;
+    row.reserve(to->size());
+    for (size_t j = 0; j < to->size(); ++j) {
+      const auto& time = times[i * to->size() + j];
+      row.push_back(time ? json::Node(*time) : json::Node(nullptr));
     }
+    rows.push_back(json::Node(std::move(row)));
+  }
+  out.insert({"times"s, json::Node(std::move(rows))});
+  return json::Node(out);
+}
+
+json::Node GetSegment(::transpot_guide::TransportCatalogue& transport_catalog,
+                      const std::string_view bus, const std::string_view from,
+                      const std::string_view to, int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  std::optional<SegmentInfo> segment;
+  if (transport_catalog.IsBus(bus) && transport_catalog.IsStop(from) &&
+      transport_catalog.IsStop(to)) {
+    segment = transport_catalog.GetSegment(transport_catalog.FindRoute(bus),
+                                           transport_catalog.FindStop(from),
+                                           transport_catalog.FindStop(to));
+  }
+  if (!segment) {
+    out.insert({"error_message"s, json::Node("not found"s)});
+    return json::Node(out);
+  }
+  out.insert({"span_count"s, json::Node(segment->span_count)});
+  out.insert({"route_length"s, json::Node(segment->road_length)});
+  out.insert({"curvature"s,
+              json::Node(segment->geo_length > 0
+                             ? segment->road_length / segment->geo_length
+                             : 1.)});
+  return json::Node(out);
+}
 
-    if (i.AsMap()["type"s] == "Stop"s) {
-      out.push_back(GetInfoStop(transport_catalog, i.AsMap()["name"].AsString(),
-                                i.AsMap()["id"].AsInt()));
+json::Node GetCorridor(const SegmentIndex& index, const json::Array& points,
+                       double radius, int id) {
+  json::Dict out;
+  out.insert({"request_id", json::Node(id)});
+  std::vector<detail::Coordinates> polyline;
+  for (const json::Node& point : points) {
+    // Точка без координат портит только свой запрос, а не весь пакет
+    const json::Dict coordinates = point.IsMap() ? point.AsMap() : json::Dict{};
+    auto latitude = coordinates.find("latitude"s);
+    auto longitude = coordinates.find("longitude"s);
+    if (latitude == coordinates.end() || longitude == coordinates.end() ||
+        !(latitude->second.IsDouble() || latitude->second.IsInt()) ||
+        !(longitude->second.IsDouble() || longitude->second.IsInt())) {
+      out.insert({"error_message"s, json::Node("not found"s)});
+      return json::Node(out);
     }
+    polyline.push_back(
+        {latitude->second.AsDouble(), longitude->second.AsDouble()});
   }
 
+  std::vector<std::string_view> names;
+  for (const Bus* bus : index.FindBuses(polyline, radius)) {
+    names.push_back(bus->name_);
+  }
+  std::sort(names.begin(), names.end());
+  json::Array buses_out;
+  for (std::string_view name : names) {
+    buses_out.push_back(json::Node(std::string(name)));
+  }
+  out.insert({"buses"s, json::Node(buses_out)});
   return json::Node(out);
 }
+
+MapViewport GetMapViewport(const json::Dict& request) {
+  MapViewport viewport;
+  if (auto bbox = request.find("bbox"s); bbox != request.end()) {
+    const json::Dict& box = bbox->second.AsMap();
+    viewport.kind = MapViewport::Kind::BBOX;
+    viewport.min = {box.at("min_lat"s).AsDouble(),
+                    box.at("min_lng"s).AsDouble()};
+    viewport.max = {box.at("max_lat"s).AsDouble(),
+                    box.at("max_lng"s).AsDouble()};
+  } else if (auto tile = request.find("tile"s); tile != request.end()) {
+    const json::Dict& address = tile->second.AsMap();
+    viewport.kind = MapViewport::Kind::TILE;
+    viewport.z = address.at("z"s).AsInt();
+    viewport.x = address.at("x"s).AsInt();
+    viewport.y = address.at("y"s).AsInt();
+  }
+  return viewport;
+}
+
+MapQuery GetMapQuery(const json::Dict& request) {
+  MapQuery query;
+  query.viewport = GetMapViewport(request);
+  if (auto buses = request.find("buses"s); buses != request.end()) {
+    query.buses.emplace();
+    for (const json::Node& name : buses->second.AsArray()) {
+      query.buses->push_back(name.AsString());
+    }
+  }
+  if (auto svgz = request.find("svgz"s);
+      svgz != request.end() && svgz->second.AsBool()) {
+    auto level = request.find("compression_level"s);
+    query.gzip_level = level != request.end() ? level->second.AsInt()
+                                              : gzip::DEFAULT_LEVEL;
+  }
+  return query;
+}
+
+namespace {
+// Общее для ответов на все запросы. Индексы для Transfers и Corridor
+// строятся при первом таком запросе, из любого потока.
+struct AnswerContext {
+  TransportCatalogue& transport_catalog;
+  MapRenderer& renderer;
+  const TransportRouter* router;
+  std::once_flag transfers_once;
+  std::optional<TransferGraph> transfers;
+  std::once_flag segments_once;
+  std::optional<SegmentIndex> segments;
+};
+
+// Печатает ответ на один запрос, перед ним — ", ", если first == false.
+// На запрос неизвестного типа ничего не печатается.
+void PrintAnswer(const json::Node& request_node, AnswerContext& context,
+                 bool& first, std::ostream& output) {
+  auto start_item = [&]() {
+    if (!first) {
+      output << ", "sv;
+    }
+    first = false;
+  };
+  auto print = [&](const json::Node& node) {
+    start_item();
+    json::PrintNode(node, output);
+  };
+
+  TransportCatalogue& transport_catalog = context.transport_catalog;
+  const TransportRouter* router = context.router;
+  const json::Dict request = request_node.AsMap();
+  auto type_itr = request.find("type"s);
+  if (type_itr == request.end() || !type_itr->second.IsString()) {
+    return;
+  }
+  const std::string type = type_itr->second.AsString();
+  auto id = [&]() { return request.at("id"s).AsInt(); };
+  auto field = [&](const std::string& key) -> const json::Node& {
+    return request.at(key);
+  };
+
+  if (type == "Bus"s) {
+    print(GetInfoRoute(transport_catalog, field("name"s).AsString(), id()));
+  } else if (type == "Map"s) {
+    const MapQuery query = GetMapQuery(request);
+    if (query.IsValid()) {
+      start_item();
+      PrintMapOfRoad(transport_catalog, context.renderer, query, id(),
+                     output);
+    } else {
+      json::Dict out;
+      out.insert({"request_id"s, json::Node(id())});
+      out.insert({"error_message"s, json::Node("not found"s)});
+      print(json::Node(out));
+    }
+  } else if (type == "Stop"s) {
+    print(GetInfoStop(transport_catalog, field("name"s).AsString(), id()));
+  } else if (type == "Route"s) {
+    print(GetJourney(transport_catalog, router, field("from"s).AsString(),
+                     field("to"s).AsString(), id()));
+  } else if (type == "Isochrone"s) {
+    print(GetIsochrone(transport_catalog, router, field("from"s).AsString(),
+                       field("time_limit"s).AsDouble(), id()));
+  } else if (type == "Transfers"s) {
+    std::call_once(context.transfers_once,
+                   [&] { context.transfers.emplace(transport_catalog); });
+    print(GetTransfers(transport_catalog, *context.transfers,
+                       field("from"s).AsString(), field("to"s).AsString(),
+                       id()));
+  } else if (type == "Matrix"s) {
+    print(GetMatrix(transport_catalog, router, field("sources"s).AsArray(),
+                    field("targets"s).AsArray(), id()));
+  } else if (type == "Segment"s) {
+    print(GetSegment(transport_catalog, field("name"s).AsString(),
+                     field("from"s).AsString(), field("to"s).AsString(),
+                     id()));
+  } else if (type == "Corridor"s) {
+    std::call_once(context.segments_once,
+                   [&] { context.segments.emplace(transport_catalog); });
+    print(GetCorridor(*context.segments, field("points"s).AsArray(),
+                      field("radius"s).AsDouble(), id()));
+  }
+}
+
+// Запросов в одной задаче исполнителя: куски поменьше ровнее делятся
+// между потоками, когда в пакете попадаются тяжёлые карты
+constexpr size_t MAX_REQUEST_CHUNK = 64;
+// Сколько кусков на поток может ждать печати
+constexpr size_t CHUNKS_IN_FLIGHT_PER_THREAD = 4;
+}  // namespace
+
+void OutputData(TransportCatalogue& transport_catalog, const json::Array& query,
+                MapRenderer& renderer, const TransportRouter* router,
+                std::ostream& output, ThreadPool* pool) {
+  AnswerContext context{transport_catalog, renderer, router, {}, {}, {}, {}};
+  output.put('[');
+  if (!pool || pool->GetThreadCount() < 2 || query.size() < 2) {
+    // Ответы печатаются по мере готовности, массив целиком не собирается
+    bool first = true;
+    for (const auto& request : query) {
+      PrintAnswer(request, context, first, output);
+    }
+    output.put(']');
+    return;
+  }
+
+  // Запросы режутся на куски подряд, каждый кусок печатается в свою
+  // строку в пуле. Готовые строки выводятся в порядке запросов; число
+  // ожидающих кусков ограничено, чтобы не держать в памяти весь ответ.
+  const size_t threads = pool->GetThreadCount();
+  const size_t chunk_size = std::clamp<size_t>(
+      query.size() / (CHUNKS_IN_FLIGHT_PER_THREAD * threads), 1,
+      MAX_REQUEST_CHUNK);
+  auto print_chunk = [&](size_t from, size_t to) {
+    std::ostringstream chunk;
+    bool first = true;
+    for (size_t i = from; i < to; ++i) {
+      PrintAnswer(query[i], context, first, chunk);
+    }
+    return std::move(chunk).str();
+  };
+
+  std::deque<std::future<std::string>> in_flight;
+  bool first = true;
+  size_t next = 0;
+  try {
+    while (next < query.size() || !in_flight.empty()) {
+      while (next < query.size() &&
+             in_flight.size() < CHUNKS_IN_FLIGHT_PER_THREAD * threads) {
+        const size_t to = std::min(query.size(), next + chunk_size);
+        in_flight.push_back(
+            pool->Submit([&print_chunk, next, to] {
+              return print_chunk(next, to);
+            }));
+        next = to;
+      }
+      const std::string chunk = in_flight.front().get();
+      in_flight.pop_front();
+      if (!chunk.empty()) {
+        if (!first) {
+          output << ", "sv;
+        }
+        first = false;
+        output << chunk;
+      }
+    }
+  } catch (...) {
+    // Задачи ссылаются на context, их нужно дождаться
+    for (auto& chunk : in_flight) {
+      chunk.wait();
+    }
+    throw;
+  }
+  output.put(']');
+}
 }  // namespace output
 }  // namespace transpot_guide
@@ -5,19 +5,71 @@
 #include "json.h"
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "transport_router.h"
+#include "transfer_graph.h"
+#include "segment_index.h"
+#include "thread_pool.h"
 
 namespace transpot_guide {
 namespace output {
 
+// Исполнение stat_requests
+struct ExecutionSettings {
+  // Потоков для ответов: 0 — общий пул программы (по числу ядер),
+  // 1 — по порядку в одном потоке
+  size_t threads = 0;
+};
+
 json::Node GetInfoRoute(::transpot_guide::TransportCatalogue& transport_catalog,
                         const std::string_view bus, int id);
 
 json::Node GetInfoStop(::transpot_guide::TransportCatalogue& transport_catalog,
                        const std::string_view stop, int id);
 
+// router == nullptr, если routing_settings не заданы
+json::Node GetJourney(::transpot_guide::TransportCatalogue& transport_catalog,
+                      const TransportRouter* router, const std::string_view from,
+                      const std::string_view to, int id);
+
+// Остановки, достижимые из from за time_limit минут
+json::Node GetIsochrone(::transpot_guide::TransportCatalogue& transport_catalog,
+                        const TransportRouter* router,
+                        const std::string_view from, double time_limit, int id);
+
+// Маршрут from -> to с наименьшим числом пересадок
+json::Node GetTransfers(::transpot_guide::TransportCatalogue& transport_catalog,
+                        const TransferGraph& transfers,
+                        const std::string_view from, const std::string_view to,
+                        int id);
+
+// Матрица времени в пути между остановками sources и targets
+json::Node GetMatrix(::transpot_guide::TransportCatalogue& transport_catalog,
+                     const TransportRouter* router, const json::Array& sources,
+                     const json::Array& targets, int id);
+
+// Длина и извилистость участка маршрута bus между остановками from и to
+json::Node GetSegment(::transpot_guide::TransportCatalogue& transport_catalog,
+                      const std::string_view bus, const std::string_view from,
+                      const std::string_view to, int id);
+
+// Автобусы, проходящие не дальше radius метров от ломаной points.
+// Если у точки нет числовых latitude и longitude — "not found".
+json::Node GetCorridor(const SegmentIndex& index, const json::Array& points,
+                       double radius, int id);
+
+// Область карты из запроса Map: ключ "bbox" или "tile", иначе вся карта
+MapViewport GetMapViewport(const json::Dict& request);
+
+// Запрос Map целиком: область и необязательный список автобусов "buses"
+MapQuery GetMapQuery(const json::Dict& request);
 
-json::Node OutputData(::transpot_guide::TransportCatalogue& transport_catalog,
-                      json::Array data, RenderSettings& setting);
+// Печатает ответы на stat_requests массивом JSON прямо в output.
+// С pool запросы исполняются кусками в нескольких потоках, порядок
+// ответов сохраняется. pool может быть и пулом renderer и router.
+void OutputData(::transpot_guide::TransportCatalogue& transport_catalog,
+                const json::Array& data, MapRenderer& renderer,
+                const TransportRouter* router, std::ostream& output,
+                ThreadPool* pool = nullptr);
 
 }  // namespace output
 
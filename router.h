@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace graph {
+
+template <typename Weight>
+class Router {
+ private:
+  using Graph = DirectedWeightedGraph<Weight>;
+
+ public:
+  static constexpr EdgeId NONE = std::numeric_limits<EdgeId>::max();
+
+  struct RouteInfo {
+    Weight weight;
+    std::vector<EdgeId> edges;
+  };
+
+  struct SearchStats {
+    size_t expanded_vertices = 0;
+  };
+
+  explicit Router(const Graph& graph) : graph_(graph) {}
+
+  // Поиск Дейкстры с ранней остановкой на to.
+  // Рабочие массивы свои у каждого потока и переиспользуются между запросами.
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to,
+                                      SearchStats* stats = nullptr) const {
+    return BuildRoute(from, to, [](VertexId) { return Weight{}; }, stats);
+  }
+
+  // A*: heuristic(v) — нижняя оценка веса пути от v до to. Оценка должна
+  // быть согласованной (h(u) <= w(u, v) + h(v)), иначе ответ не оптимален.
+  template <typename Heuristic>
+  std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to,
+                                      Heuristic heuristic,
+                                      SearchStats* stats = nullptr) const;
+
+  // Дейкстра от from без цели: visit(vertex, weight, prev_edge) вызывается
+  // для каждой вершины в порядке окончательного достижения. Вершины тяжелее
+  // limit не посещаются. Если visit возвращает bool, false останавливает
+  // поиск.
+  template <typename Visitor>
+  void Explore(VertexId from, Visitor visit,
+               Weight limit = std::numeric_limits<Weight>::max()) const;
+
+  const Graph& GetGraph() const { return graph_; }
+
+ private:
+  struct Workspace {
+    std::vector<Weight> weights;
+    std::vector<Weight> estimates;  // значение эвристики, считается один раз
+    std::vector<EdgeId> prev_edges;
+    std::vector<bool> reached;  // битовое множество, чистится по touched
+    std::vector<VertexId> touched;
+    std::vector<std::pair<Weight, VertexId>> heap;
+
+    void Prepare(size_t vertex_count);
+    void Reset();
+  };
+
+  static Workspace& GetWorkspace();
+
+  const Graph& graph_;
+};
+
+template <typename Weight>
+void Router<Weight>::Workspace::Prepare(size_t vertex_count) {
+  if (reached.size() < vertex_count) {
+    weights.resize(vertex_count);
+    estimates.resize(vertex_count);
+    prev_edges.resize(vertex_count, NONE);
+    reached.resize(vertex_count, false);
+  }
+}
+
+template <typename Weight>
+void Router<Weight>::Workspace::Reset() {
+  for (VertexId vertex : touched) {
+    reached[vertex] = false;
+    prev_edges[vertex] = NONE;
+  }
+  touched.clear();
+  heap.clear();
+}
+
+template <typename Weight>
+typename Router<Weight>::Workspace& Router<Weight>::GetWorkspace() {
+  thread_local Workspace workspace;
+  return workspace;
+}
+
+template <typename Weight>
+template <typename Heuristic>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
+    VertexId from, VertexId to, Heuristic heuristic, SearchStats* stats) const {
+  Workspace& ws = GetWorkspace();
+  ws.Prepare(graph_.GetVertexCount());
+
+  // В куче лежит вес пути плюс оценка остатка
+  const auto heap_cmp = std::greater<std::pair<Weight, VertexId>>{};
+  auto reach = [&](VertexId vertex, Weight weight, EdgeId prev_edge) {
+    if (!ws.reached[vertex]) {
+      ws.reached[vertex] = true;
+      ws.touched.push_back(vertex);
+      ws.estimates[vertex] = heuristic(vertex);
+    }
+    ws.weights[vertex] = weight;
+    ws.prev_edges[vertex] = prev_edge;
+    ws.heap.push_back({weight + ws.estimates[vertex], vertex});
+    std::push_heap(ws.heap.begin(), ws.heap.end(), heap_cmp);
+  };
+  reach(from, Weight{}, NONE);
+
+  bool found = false;
+  size_t expanded = 0;
+  while (!ws.heap.empty()) {
+    std::pop_heap(ws.heap.begin(), ws.heap.end(), heap_cmp);
+    const auto [key, vertex] = ws.heap.back();
+    ws.heap.pop_back();
+    const Weight weight = ws.weights[vertex];
+    if (weight + ws.estimates[vertex] < key) {
+      continue;
+    }
+    if (vertex == to) {
+      found = true;
+      break;
+    }
+    ++expanded;
+    for (EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+      const auto& edge = graph_.GetEdge(edge_id);
+      const Weight new_weight = weight + edge.weight;
+      if (!ws.reached[edge.to] || new_weight < ws.weights[edge.to]) {
+        reach(edge.to, new_weight, edge_id);
+      }
+    }
+  }
+  if (stats) {
+    stats->expanded_vertices = expanded;
+  }
+
+  std::optional<RouteInfo> result;
+  if (found) {
+    RouteInfo info{ws.weights[to], {}};
+    for (EdgeId edge_id = ws.prev_edges[to]; edge_id != NONE;
+         edge_id = ws.prev_edges[graph_.GetEdge(edge_id).from]) {
+      info.edges.push_back(edge_id);
+    }
+    std::reverse(info.edges.begin(), info.edges.end());
+    result = std::move(info);
+  }
+  ws.Reset();
+  return result;
+}
+
+template <typename Weight>
+template <typename Visitor>
+void Router<Weight>::Explore(VertexId from, Visitor visit, Weight limit) const {
+  Workspace& ws = GetWorkspace();
+  ws.Prepare(graph_.GetVertexCount());
+
+  const auto heap_cmp = std::greater<std::pair<Weight, VertexId>>{};
+  auto reach = [&](VertexId vertex, Weight weight, EdgeId prev_edge) {
+    if (!ws.reached[vertex]) {
+      ws.reached[vertex] = true;
+      ws.touched.push_back(vertex);
+    }
+    ws.weights[vertex] = weight;
+    ws.prev_edges[vertex] = prev_edge;
+    ws.heap.push_back({weight, vertex});
+    std::push_heap(ws.heap.begin(), ws.heap.end(), heap_cmp);
+  };
+  reach(from, Weight{}, NONE);
+
+  while (!ws.heap.empty()) {
+    std::pop_heap(ws.heap.begin(), ws.heap.end(), heap_cmp);
+    const auto [weight, vertex] = ws.heap.back();
+    ws.heap.pop_back();
+    if (ws.weights[vertex] < weight) {
+      continue;
+    }
+    if constexpr (std::is_same_v<
+                      std::invoke_result_t<Visitor, VertexId, Weight, EdgeId>,
+                      bool>) {
+      if (!visit(vertex, weight, ws.prev_edges[vertex])) {
+        break;
+      }
+    } else {
+      visit(vertex, weight, ws.prev_edges[vertex]);
+    }
+    for (EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+      const auto& edge = graph_.GetEdge(edge_id);
+      const Weight new_weight = weight + edge.weight;
+      if (limit < new_weight) {
+        continue;
+      }
+      if (!ws.reached[edge.to] || new_weight < ws.weights[edge.to]) {
+        reach(edge.to, new_weight, edge_id);
+      }
+    }
+  }
+  ws.Reset();
+}
+
+}  // namespace graph
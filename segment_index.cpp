@@ -0,0 +1,120 @@
+#include "segment_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace transpot_guide {
+namespace {
+template <typename Point>
+double GetSquaredDistance(Point point, Point from, Point to) {
+  const double dx = to.x - from.x;
+  const double dy = to.y - from.y;
+  const double length = dx * dx + dy * dy;
+  double t = 0;
+  if (length > 0) {
+    t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length,
+                   0., 1.);
+  }
+  const double x = from.x + t * dx - point.x;
+  const double y = from.y + t * dy - point.y;
+  return x * x + y * y;
+}
+
+template <typename Point>
+double Cross(Point origin, Point a, Point b) {
+  return (a.x - origin.x) * (b.y - origin.y) -
+         (a.y - origin.y) * (b.x - origin.x);
+}
+
+// Квадрат расстояния между отрезками: ноль при пересечении, иначе
+// наименьшее из расстояний от концов до другого отрезка
+template <typename Point>
+double GetSquaredDistance(Point a, Point b, Point c, Point d) {
+  const double abc = Cross(a, b, c);
+  const double abd = Cross(a, b, d);
+  const double cda = Cross(c, d, a);
+  const double cdb = Cross(c, d, b);
+  if (((abc > 0 && abd < 0) || (abc < 0 && abd > 0)) &&
+      ((cda > 0 && cdb < 0) || (cda < 0 && cdb > 0))) {
+    return 0;
+  }
+  return std::min({GetSquaredDistance(a, c, d), GetSquaredDistance(b, c, d),
+                   GetSquaredDistance(c, a, b), GetSquaredDistance(d, a, b)});
+}
+}  // namespace
+
+SegmentIndex::SegmentIndex(const TransportCatalogue& catalogue)
+    : catalogue_(catalogue) {
+  const auto& stops = catalogue_.GetStopList();
+  double latitude_sum = 0;
+  for (const Stop& stop : stops) {
+    latitude_sum += stop.GetCoordinates().lat;
+  }
+  const double mean_latitude = stops.empty() ? 0 : latitude_sum / stops.size();
+  lat_scale_ = detail::GetDegreeLength();
+  lng_scale_ = lat_scale_ * std::cos(mean_latitude * detail::DEGREE_TO_RADIAN);
+
+  for (const Bus& bus : catalogue_.GetBusList()) {
+    if (bus.route_stops_.size() == 1) {
+      const Point point = Project(bus.route_stops_[0]->GetCoordinates());
+      segments_.push_back({point, point, static_cast<uint32_t>(bus.id_)});
+    }
+    for (size_t i = 1; i < bus.route_stops_.size(); ++i) {
+      segments_.push_back({Project(bus.route_stops_[i - 1]->GetCoordinates()),
+                           Project(bus.route_stops_[i]->GetCoordinates()),
+                           static_cast<uint32_t>(bus.id_)});
+    }
+  }
+
+  std::vector<PackedRTree::Box> boxes;
+  boxes.reserve(segments_.size());
+  for (const Segment& s : segments_) {
+    boxes.push_back({std::min(s.from.x, s.to.x), std::min(s.from.y, s.to.y),
+                     std::max(s.from.x, s.to.x), std::max(s.from.y, s.to.y)});
+  }
+  tree_ = PackedRTree(boxes);
+}
+
+SegmentIndex::Point SegmentIndex::Project(
+    detail::Coordinates coordinates) const {
+  return {coordinates.lng * lng_scale_, coordinates.lat * lat_scale_};
+}
+
+std::vector<const Bus*> SegmentIndex::FindBuses(
+    const std::vector<detail::Coordinates>& points, double radius) const {
+  std::vector<uint32_t> found;
+  const double squared_radius = radius * radius;
+
+  // Точка — вырожденный отрезок
+  const size_t query_count = points.size() > 1 ? points.size() - 1 : points.size();
+  for (size_t i = 0; i < query_count; ++i) {
+    const Point from = Project(points[i]);
+    const Point to = Project(points[std::min(i + 1, points.size() - 1)]);
+    const PackedRTree::Box query{std::min(from.x, to.x) - radius,
+                                 std::min(from.y, to.y) - radius,
+                                 std::max(from.x, to.x) + radius,
+                                 std::max(from.y, to.y) + radius};
+    tree_.Search(query, [&](size_t index) {
+      const Segment& segment = segments_[index];
+      if (GetSquaredDistance(from, to, segment.from, segment.to) <=
+          squared_radius) {
+        found.push_back(segment.bus);
+      }
+    });
+  }
+
+  std::sort(found.begin(), found.end());
+  found.erase(std::unique(found.begin(), found.end()), found.end());
+  const auto& buses = catalogue_.GetBusList();
+  std::vector<const Bus*> result;
+  result.reserve(found.size());
+  for (uint32_t bus : found) {
+    result.push_back(&buses[bus]);
+  }
+  return result;
+}
+
+size_t SegmentIndex::GetSegmentCount() const { return segments_.size(); }
+
+}  // namespace transpot_guide
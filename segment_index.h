@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "domain.h"
+#include "geo.h"
+#include "packed_rtree.h"
+#include "transport_catalogue.h"
+
+namespace transpot_guide {
+
+// Индекс отрезков маршрутов между соседними остановками на PackedRTree.
+// Координаты переводятся в метры плоской проекцией со средней широтой
+// остановок, поэтому индекс рассчитан на сеть масштаба города.
+class SegmentIndex {
+ public:
+  explicit SegmentIndex(const TransportCatalogue& catalogue);
+
+  // Автобусы, маршрут которых проходит не дальше radius метров от ломаной
+  // points (для одной точки — от точки), в порядке добавления в каталог
+  std::vector<const Bus*> FindBuses(
+      const std::vector<detail::Coordinates>& points, double radius) const;
+
+  size_t GetSegmentCount() const;
+
+ private:
+  struct Point {
+    double x;
+    double y;
+  };
+
+  struct Segment {
+    Point from;
+    Point to;
+    uint32_t bus;
+  };
+
+  Point Project(detail::Coordinates coordinates) const;
+
+  const TransportCatalogue& catalogue_;
+  double lat_scale_ = 0;  // м на градус
+  double lng_scale_ = 0;
+  std::vector<Segment> segments_;
+  PackedRTree tree_;
+};
+
+}  // namespace transpot_guide
@@ -42,14 +42,6 @@ std::string  ColorPrinter::operator()(Rgba color) {
     return out_s.str();
 }
 
-void Object::Render(const RenderContext& context) const {
-  context.RenderIndent();
-
-  RenderObject(context);
-
-  context.out << std::endl;
-}
-
 Circle& Circle::SetCenter(Point center) {
   center_ = center;
   return *this;
@@ -60,6 +52,44 @@ Circle& Circle::SetRadius(double radius) {
   return *this;
 }
 
+void RenderColor(Writer& out, const Color& color) {
+  if (std::holds_alternative<std::monostate>(color)) {
+    out << "none"sv;
+  } else if (const std::string* name = std::get_if<std::string>(&color)) {
+    out << *name;
+  } else {
+    out << std::visit(ColorPrinter{}, color);
+  }
+}
+
+Writer& operator<<(Writer& out, StrokeLineCap line_cap) {
+  switch (line_cap) {
+    case StrokeLineCap::BUTT:
+      return out << "butt"sv;
+    case StrokeLineCap::ROUND:
+      return out << "round"sv;
+    case StrokeLineCap::SQUARE:
+      return out << "square"sv;
+  }
+  return out;
+}
+
+Writer& operator<<(Writer& out, StrokeLineJoin line_join) {
+  switch (line_join) {
+    case StrokeLineJoin::ARCS:
+      return out << "arcs"sv;
+    case StrokeLineJoin::BEVEL:
+      return out << "bevel"sv;
+    case StrokeLineJoin::MITER:
+      return out << "miter"sv;
+    case StrokeLineJoin::MITER_CLIP:
+      return out << "miter-clip"sv;
+    case StrokeLineJoin::ROUND:
+      return out << "round"sv;
+  }
+  return out;
+}
+
 void Circle::RenderObject(const RenderContext& context) const {
   auto& out = context.out;
   out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
@@ -73,9 +103,18 @@ Polyline& Polyline::AddPoint(Point point) {
   return *this;
 }
 
+Polyline& Polyline::SetId(std::string id) {
+  id_ = std::move(id);
+  return *this;
+}
+
 void Polyline::RenderObject(const RenderContext& context) const {
   auto& out = context.out;
-  out << "<polyline points="s;
+  out << "<polyline"sv;
+  if (!id_.empty()) {
+    out << " id=\""sv << id_ << "\""sv;
+  }
+  out << " points="sv;
   if (!points_.empty()) {
     out << "\""sv;
     bool first = true;
@@ -144,20 +183,95 @@ void Text::RenderObject(const RenderContext& context) const {
   out << "\">" << data_ << "</text>";
 }
 
+Use& Use::SetHref(std::string id) {
+  href_ = std::move(id);
+  return *this;
+}
+
+Use& Use::SetOffset(Point offset) {
+  offset_ = offset;
+  return *this;
+}
+
+void Use::RenderObject(const RenderContext& context) const {
+  auto& out = context.out;
+  out << "<use xlink:href=\"#"sv << href_ << "\" x=\""sv << offset_.x << "\" y=\""sv
+      << offset_.y << "\""sv;
+  RenderAttrs(context.out);
+  out << "/>"sv;
+}
+
+void ObjectArena::Push(ObjectHolder&& obj) {
+  const size_t block = size_ / BLOCK_SIZE;
+  if (block == blocks_.size()) {
+    blocks_.emplace_back().reserve(BLOCK_SIZE);
+  }
+  blocks_[block].push_back(std::move(obj));
+  ++size_;
+}
+
+void ObjectArena::Reserve(size_t count) {
+  while (blocks_.size() * BLOCK_SIZE < count) {
+    blocks_.emplace_back().reserve(BLOCK_SIZE);
+  }
+}
+
+size_t ObjectArena::GetSize() const { return size_; }
+
 void Document::AddPtr(std::unique_ptr<Object>&& obj) {
-  objects_.push_back(std::move(obj));
+  if (dynamic_cast<const Use*>(obj.get())) {
+    has_links_ = true;
+  }
+  objects_.Push(std::move(obj));
 }
 
-void Document::Render(std::ostream& out) const {
-  out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv
-            << std::endl;
-  RenderContext render(out, 2, 2);
+void Document::AddObject(ObjectHolder&& obj) { objects_.Push(std::move(obj)); }
 
-  for (auto& i : objects_) {
-    i.get()->Render(render);
+void Document::Reserve(size_t count) { objects_.Reserve(count); }
+
+void Document::Render(std::ostream& output) const {
+  Writer out(output);
+  RenderBegin(out, has_links_);
+  RenderContext render = GetObjectContext(out);
+
+  objects_.ForEach([&render](const ObjectHolder& object) {
+    std::visit(
+        [&render](const auto& value) {
+          if constexpr (std::is_same_v<std::decay_t<decltype(value)>,
+                                       std::unique_ptr<Object>>) {
+            value->Render(render);
+          } else {
+            value.Render(render);
+          }
+        },
+        object);
+  });
+  RenderEnd(out);
+}
+
+void Document::RenderBegin(Writer& out, bool links) {
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\""sv;
+  if (links) {
+    out << " xmlns:xlink=\"http://www.w3.org/1999/xlink\""sv;
   }
-  out << "</svg>"sv;
+  out << " version=\"1.1\">\n"sv;
+}
+
+void Document::RenderEnd(Writer& out) { out << "</svg>"sv; }
+
+RenderContext Document::GetObjectContext(Writer& out) {
+  return RenderContext(out, 2, 2);
+}
+
+void Document::RenderDefsBegin(const RenderContext& context) {
+  context.RenderIndent();
+  context.out << "<defs>\n"sv;
+}
+
+void Document::RenderDefsEnd(const RenderContext& context) {
+  context.RenderIndent();
+  context.out << "</defs>\n"sv;
 }
 
 }  // namespace svg
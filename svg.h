@@ -1,10 +1,13 @@
 #pragma once
 
+#include <charconv>
 #include <cstdint>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -53,6 +56,75 @@ struct ColorPrinter {
   std::string operator()(Rgba color);
 };
 
+// Буферизованный вывод SVG. Копит текст в строке и отдаёт его в поток
+// кусками, без сброса после каждого объекта. Числа печатаются через
+// to_chars так же, как их печатает std::ostream по умолчанию (%g).
+class Writer {
+ public:
+  // Пишет в out; остаток буфера отдаётся в деструкторе или во Flush
+  explicit Writer(std::ostream& out) : out_(&out), buffer_(own_buffer_) {
+    own_buffer_.reserve(BUFFER_SIZE);
+  }
+
+  // Дописывает всё в target
+  explicit Writer(std::string& target) : buffer_(target) {}
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  ~Writer() { Flush(); }
+
+  Writer& operator<<(std::string_view text) {
+    buffer_.append(text);
+    Spill();
+    return *this;
+  }
+
+  Writer& operator<<(char c) {
+    buffer_.push_back(c);
+    return *this;
+  }
+
+  Writer& operator<<(double value) {
+    char number[32];
+    const auto result = std::to_chars(number, number + sizeof(number), value,
+                                      std::chars_format::general, 6);
+    buffer_.append(number, result.ptr);
+    return *this;
+  }
+
+  Writer& operator<<(uint32_t value) {
+    char number[16];
+    const auto result =
+        std::to_chars(number, number + sizeof(number), value);
+    buffer_.append(number, result.ptr);
+    return *this;
+  }
+
+  void Flush() {
+    if (out_ && !buffer_.empty()) {
+      out_->write(buffer_.data(), buffer_.size());
+      buffer_.clear();
+    }
+  }
+
+ private:
+  static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+  void Spill() {
+    if (out_ && buffer_.size() >= BUFFER_SIZE) {
+      Flush();
+    }
+  }
+
+  std::ostream* out_ = nullptr;
+  std::string own_buffer_;
+  std::string& buffer_;
+};
+
+// Печатает цвет без промежуточной строки
+void RenderColor(Writer& out, const Color& color);
+
 inline std::ostream& operator<<(std::ostream& out, const StrokeLineCap& other) {
   switch (other) {
     case StrokeLineCap::BUTT:
@@ -98,6 +170,14 @@ inline std::ostream& operator<<(std::ostream& out,
   return out;
 }
 
+Writer& operator<<(Writer& out, StrokeLineCap line_cap);
+
+Writer& operator<<(Writer& out, StrokeLineJoin line_join);
+
+// Атрибуты оформления, уже переведённые в текст. Строка общая у всех
+// объектов с таким оформлением.
+using PreparedAttrs = std::shared_ptr<const std::string>;
+
 template <typename Owner>
 class PathProps {
  public:
@@ -125,20 +205,47 @@ class PathProps {
     return AsOwner();
   }
 
+  // Атрибуты из PrepareAttrs: объект печатает их как есть вместо своих
+  // цветов и толщин
+  Owner& SetPreparedAttrs(PreparedAttrs attrs) {
+    prepared_attrs_ = std::move(attrs);
+    return AsOwner();
+  }
+
+  // Текст атрибутов оформления — один раз на много одинаковых объектов
+  PreparedAttrs PrepareAttrs() const {
+    std::string attrs;
+    {
+      Writer out(attrs);
+      RenderAttrs(out);
+    }
+    return std::make_shared<const std::string>(std::move(attrs));
+  }
+
  protected:
+  // Деструктор объявлен явно, поэтому перемещение нужно вернуть вручную
+  PathProps() = default;
+  PathProps(const PathProps&) = default;
+  PathProps(PathProps&&) noexcept = default;
+  PathProps& operator=(const PathProps&) = default;
+  PathProps& operator=(PathProps&&) noexcept = default;
   ~PathProps() = default;
 
-  void RenderAttrs(std::ostream& out) const {
+  void RenderAttrs(Writer& out) const {
     using namespace std::literals;
 
+    if (prepared_attrs_) {
+      out << *prepared_attrs_;
+      return;
+    }
     if (fill_color_) {
       out << " fill=\""sv;
-      out << std::visit(ColorPrinter{}, *fill_color_);
+      RenderColor(out, *fill_color_);
       out << "\""sv;
     }
     if (stroke_color_) {
       out << " stroke=\""sv;
-      out << std::visit(ColorPrinter{}, *stroke_color_);
+      RenderColor(out, *stroke_color_);
       out << "\""sv;
     }
 
@@ -148,12 +255,10 @@ class PathProps {
 
     if (stroke_linecap_) {
       out << " stroke-linecap=\""sv << *stroke_linecap_ << "\""sv;
-      ;
     }
 
     if (stroke_linejoin_) {
       out << " stroke-linejoin=\""sv << *stroke_linejoin_ << "\""sv;
-      ;
     }
   }
 
@@ -169,12 +274,13 @@ class PathProps {
   std::optional<double> stroke_width_;
   std::optional<StrokeLineCap> stroke_linecap_;
   std::optional<StrokeLineJoin> stroke_linejoin_;
+  PreparedAttrs prepared_attrs_;
 };
 
 struct RenderContext {
-  RenderContext(std::ostream& out) : out(out) {}
+  RenderContext(Writer& out) : out(out) {}
 
-  RenderContext(std::ostream& out, int indent_step, int indent = 0)
+  RenderContext(Writer& out, int indent_step, int indent = 0)
       : out(out), indent_step(indent_step), indent(indent) {}
 
   RenderContext Indented() const {
@@ -183,18 +289,23 @@ struct RenderContext {
 
   void RenderIndent() const {
     for (int i = 0; i < indent; ++i) {
-      out.put(' ');
+      out << ' ';
     }
   }
 
-  std::ostream& out;
+  Writer& out;
   int indent_step = 0;
   int indent = 0;
 };
 
 class Object {
  public:
-  void Render(const RenderContext& context) const;
+  // Встроена, чтобы для final-наследников RenderObject вызывался напрямую
+  void Render(const RenderContext& context) const {
+    context.RenderIndent();
+    RenderObject(context);
+    context.out << '\n';
+  }
 
   virtual ~Object() = default;
 
@@ -214,18 +325,22 @@ class Circle final : public Object, public PathProps<Circle> {
   double radius_ = 1.0;
 };
 
-class Polyline : public Object, public PathProps<Polyline> {
+class Polyline final : public Object, public PathProps<Polyline> {
  public:
   // Добавляет очередную вершину к ломаной линии
   Polyline& AddPoint(Point point);
 
+  // Задаёт идентификатор для ссылок из <use> (атрибут id)
+  Polyline& SetId(std::string id);
+
  private:
   void RenderObject(const RenderContext& context) const override;
 
   std::vector<Point> points_;
+  std::string id_;
 };
 
-class Text : public Object, public PathProps<Text> {
+class Text final : public Object, public PathProps<Text> {
  public:
   // Задаёт координаты опорной точки (атрибуты x и y)
   Text& SetPosition(Point pos);
@@ -258,6 +373,59 @@ class Text : public Object, public PathProps<Text> {
   std::string data_;
 };
 
+// Копия объекта из <defs> с заданным id, сдвинутая на offset (элемент
+// <use>). Свойства оформления, не заданные у самого объекта, берутся у
+// копии. Ссылка пишется как xlink:href, чтобы её понимали программы,
+// читающие SVG 1.1; документ с такими объектами должен объявлять
+// xmlns:xlink (см. Document::RenderBegin).
+class Use final : public Object, public PathProps<Use> {
+ public:
+  Use& SetHref(std::string id);
+
+  // Задаёт сдвиг копии (атрибуты x и y)
+  Use& SetOffset(Point offset);
+
+ private:
+  void RenderObject(const RenderContext& context) const override;
+
+  std::string href_;
+  Point offset_;
+};
+
+// Объект документа. Circle, Polyline и Text хранятся по значению,
+// прочие наследники Object — через указатель.
+using ObjectHolder =
+    std::variant<Circle, Polyline, Text, std::unique_ptr<Object>>;
+
+// Хранилище объектов документа: блоки по BLOCK_SIZE объектов. Блоки не
+// перевыделяются, поэтому добавление не перемещает прежние объекты.
+class ObjectArena {
+ public:
+  void Push(ObjectHolder&& obj);
+
+  void Reserve(size_t count);
+
+  size_t GetSize() const;
+
+  template <typename Func>
+  void ForEach(Func func) const;
+
+ private:
+  static constexpr size_t BLOCK_SIZE = 256;
+
+  std::vector<std::vector<ObjectHolder>> blocks_;
+  size_t size_ = 0;
+};
+
+template <typename Func>
+void ObjectArena::ForEach(Func func) const {
+  for (const auto& block : blocks_) {
+    for (const ObjectHolder& object : block) {
+      func(object);
+    }
+  }
+}
+
 class ObjectContainer {
  public:
   template <typename Obj>
@@ -265,10 +433,12 @@ class ObjectContainer {
 
   virtual void AddPtr(std::unique_ptr<Object>&& obj) = 0;
 
+  virtual void AddObject(ObjectHolder&& obj) = 0;
+
   virtual ~ObjectContainer() = default;
 
  protected:
-  std::vector<std::shared_ptr<Object>> objects_;
+  ObjectArena objects_;
 };
 
 class Drawable {
@@ -282,12 +452,36 @@ class Document : public ObjectContainer {
  public:
   void AddPtr(std::unique_ptr<Object>&& obj) override;
 
+  void AddObject(ObjectHolder&& obj) override;
+
+  // Резервирует место под count объектов
+  void Reserve(size_t count);
+
   void Render(std::ostream& out) const;
+
+  // Начало и конец документа и контекст его объектов — для документа,
+  // склеенного из отдельно нарисованных кусков. С links корень объявляет
+  // пространство имён xlink для элементов <use>.
+  static void RenderBegin(Writer& out, bool links = false);
+  static void RenderEnd(Writer& out);
+  static RenderContext GetObjectContext(Writer& out);
+  // Обёртка <defs> для объектов, на которые ссылаются элементы <use>.
+  // Сами объекты рисуются с context.Indented().
+  static void RenderDefsBegin(const RenderContext& context);
+  static void RenderDefsEnd(const RenderContext& context);
+
+ private:
+  bool has_links_ = false;  // есть ли элементы <use>
 };
 
 template <typename Obj>
 void ObjectContainer::Add(Obj obj) {
-  AddPtr(std::make_unique<Obj>(std::move(obj)));
+  if constexpr (std::is_same_v<Obj, Circle> || std::is_same_v<Obj, Polyline> ||
+                std::is_same_v<Obj, Text>) {
+    AddObject(std::move(obj));
+  } else {
+    AddPtr(std::make_unique<Obj>(std::move(obj)));
+  }
 }
 
 }  // namespace svg
@@ -0,0 +1,214 @@
+// Проверка gzip::GzipBuffer и base64::Base64Buffer: сжатое распаковывается
+// zlib и сравнивается с исходным, base64 — с известными значениями.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. tests/gzip_test.cpp gzip.cpp base64.cpp -lz
+//       -o gzip_test && ./gzip_test
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base64.h"
+#include "gzip.h"
+
+using namespace std::literals;
+
+namespace {
+int failures = 0;
+
+void Check(bool condition, std::string_view what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << '\n';
+    ++failures;
+  }
+}
+
+// Распаковка zlib; он же проверяет CRC-32 и длину из конца потока
+bool Gunzip(const std::string& compressed, std::string& output) {
+  z_stream stream{};
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+    return false;
+  }
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  char buffer[1 << 16];
+  int status = Z_OK;
+  while (status == Z_OK) {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    output.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  const bool complete = status == Z_STREAM_END && stream.avail_in == 0;
+  inflateEnd(&stream);
+  return complete;
+}
+
+std::string DecodeBase64(std::string_view text) {
+  auto value = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+  };
+  std::string output;
+  uint32_t group = 0;
+  int bits = 0;
+  for (char c : text) {
+    const int v = value(c);
+    if (v < 0) {
+      break;
+    }
+    group = group << 6 | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      output.push_back(static_cast<char>(group >> bits & 0xFF));
+    }
+  }
+  return output;
+}
+
+// Пишет data в поток кусками по chunk байт (0 — одним куском)
+void WriteChunked(std::ostream& output, const std::string& data, size_t chunk) {
+  if (chunk == 0) {
+    output.write(data.data(), data.size());
+    return;
+  }
+  for (size_t pos = 0; pos < data.size(); pos += chunk) {
+    output.write(data.data() + pos, std::min(chunk, data.size() - pos));
+  }
+}
+
+std::string Compress(const std::string& data, int level, size_t chunk) {
+  std::ostringstream compressed;
+  {
+    gzip::GzipBuffer buffer(compressed, level);
+    std::ostream output(&buffer);
+    WriteChunked(output, data, chunk);
+    output.flush();
+    buffer.Finish();
+  }
+  return compressed.str();
+}
+
+std::vector<std::pair<std::string, std::string>> MakeInputs() {
+  std::vector<std::pair<std::string, std::string>> inputs;
+  inputs.push_back({"empty", ""});
+  inputs.push_back({"one byte", "x"});
+  inputs.push_back({"short", "<svg xmlns=\"http://www.w3.org/2000/svg\"/>"});
+
+  // Похоже на карту: много повторов на разных расстояниях, больше
+  // нескольких блоков и окна
+  std::mt19937 random(17);
+  std::string svg;
+  while (svg.size() < 600000) {
+    svg += "  <polyline points=\"";
+    for (int i = 0; i < 8; ++i) {
+      svg += std::to_string(random() % 1000) + "." +
+             std::to_string(random() % 100000) + "," +
+             std::to_string(random() % 1000) + " ";
+    }
+    svg += "\" fill=\"none\" stroke=\"green\" stroke-width=\"14\"/>\n";
+  }
+  inputs.push_back({"svg", svg});
+
+  // Несжимаемое идёт несжатыми блоками
+  std::string noise(300000, '\0');
+  for (char& c : noise) {
+    c = static_cast<char>(random());
+  }
+  inputs.push_back({"noise", noise});
+
+  inputs.push_back({"long run", std::string(400000, 'a')});
+  return inputs;
+}
+
+void TestGzip() {
+  for (const auto& [name, data] : MakeInputs()) {
+    for (int level = gzip::MIN_LEVEL; level <= gzip::MAX_LEVEL; ++level) {
+      for (size_t chunk : {size_t{0}, size_t{1}, size_t{4093}}) {
+        if (chunk == 1 && data.size() > 100000) {
+          continue;
+        }
+        const std::string compressed = Compress(data, level, chunk);
+        std::string restored;
+        const std::string what = name + ", level " + std::to_string(level) +
+                                 ", chunk " + std::to_string(chunk);
+        Check(Gunzip(compressed, restored), "gunzip " + what);
+        Check(restored == data, "round trip " + what);
+      }
+    }
+  }
+}
+
+std::string EncodeBase64(const std::string& data, size_t chunk) {
+  std::string encoded;
+  base64::Base64Buffer buffer(encoded);
+  std::ostream output(&buffer);
+  WriteChunked(output, data, chunk);
+  output.flush();
+  buffer.Finish();
+  return encoded;
+}
+
+void TestBase64() {
+  // RFC 4648, раздел 10
+  const std::pair<std::string, std::string> vectors[] = {
+      {"", ""},         {"f", "Zg=="},         {"fo", "Zm8="},
+      {"foo", "Zm9v"},  {"foob", "Zm9vYg=="},  {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"}};
+  for (const auto& [data, expected] : vectors) {
+    for (size_t chunk : {size_t{0}, size_t{1}, size_t{2}}) {
+      Check(EncodeBase64(data, chunk) == expected, "base64 of \"" + data + "\"");
+    }
+  }
+  std::string bytes;
+  for (int i = 0; i < 1000; ++i) {
+    bytes.push_back(static_cast<char>(i * 37));
+  }
+  Check(DecodeBase64(EncodeBase64(bytes, 7)) == bytes, "base64 round trip");
+}
+
+// Так карта SVGZ попадает в ответ: gzip поверх base64
+void TestSvgzChain() {
+  const std::string data = MakeInputs()[3].second;
+  std::string encoded;
+  {
+    base64::Base64Buffer base64(encoded);
+    std::ostream encoded_stream(&base64);
+    gzip::GzipBuffer gzip(encoded_stream, gzip::DEFAULT_LEVEL);
+    std::ostream output(&gzip);
+    WriteChunked(output, data, 1000);
+    output.flush();
+    gzip.Finish();
+    encoded_stream.flush();
+    base64.Finish();
+  }
+  std::string restored;
+  Check(Gunzip(DecodeBase64(encoded), restored) && restored == data,
+        "svgz chain");
+}
+}  // namespace
+
+int main() {
+  TestGzip();
+  TestBase64();
+  TestSvgzChain();
+  if (failures > 0) {
+    std::cerr << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "OK\n";
+  return 0;
+}
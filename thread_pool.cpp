@@ -0,0 +1,144 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+// Пул и номер очереди текущего рабочего потока
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < thread_count; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < thread_count; ++i) {
+    threads_.emplace_back([this, i] { Work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard guard(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+size_t ThreadPool::GetThreadCount() const { return threads_.size(); }
+
+void ThreadPool::Push(Task task) {
+  const size_t index = current_pool == this
+                           ? current_index
+                           : next_queue_++ % queues_.size();
+  {
+    std::lock_guard guard(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard guard(wake_mutex_);
+    ++pending_;
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::TryPop(size_t index, Task& task) {
+  {
+    Queue& own = *queues_[index];
+    std::lock_guard guard(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    Queue& other = *queues_[(index + i) % queues_.size()];
+    std::lock_guard guard(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::RunPendingTask(size_t index) {
+  Task task;
+  if (!TryPop(index, task)) {
+    return false;
+  }
+  --pending_;
+  task();
+  return true;
+}
+
+void ThreadPool::Work(size_t index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    if (RunPendingTask(index)) {
+      continue;
+    }
+    std::unique_lock lock(wake_mutex_);
+    wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end,
+                             const std::function<void(size_t)>& func,
+                             size_t grain) {
+  if (begin >= end) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunk_count =
+      std::min((end - begin + grain - 1) / grain, 4 * queues_.size());
+  const size_t chunk = (end - begin + chunk_count - 1) / chunk_count;
+
+  std::vector<std::future<void>> results;
+  for (size_t from = begin; from < end; from += chunk) {
+    const size_t to = std::min(end, from + chunk);
+    results.push_back(Submit([&func, from, to] {
+      for (size_t i = from; i < to; ++i) {
+        func(i);
+      }
+    }));
+  }
+
+  // Поток пула помогает выполнять задачи, остальные просто ждут.
+  // Ждутся все куски: задачи ссылаются на func, поэтому исключение первого
+  // упавшего куска пробрасывается только после них.
+  std::exception_ptr error;
+  for (auto& result : results) {
+    if (current_pool == this) {
+      while (result.wait_for(std::chrono::seconds(0)) !=
+             std::future_status::ready) {
+        if (!RunPendingTask(current_index)) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    try {
+      result.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
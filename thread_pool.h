@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Пул потоков с захватом работы: у каждого потока своя очередь, свободный
+// поток берёт задачи из чужих очередей. Поток пула, ждущий результата
+// ParallelFor, тоже выполняет задачи, поэтому вложенные вызовы не
+// приводят к взаимной блокировке. Посторонний поток просто ждёт.
+class ThreadPool {
+ public:
+  // thread_count == 0 — по числу ядер
+  explicit ThreadPool(size_t thread_count = 0);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  size_t GetThreadCount() const;
+
+  template <typename Func>
+  std::future<std::invoke_result_t<Func>> Submit(Func func);
+
+  // Вызывает func(i) для всех i из [begin, end) и ждёт завершения.
+  // Диапазон режется на куски не меньше grain. Если func бросила
+  // исключение, оно пробрасывается после завершения всех кусков.
+  void ParallelFor(size_t begin, size_t end,
+                   const std::function<void(size_t)>& func, size_t grain = 1);
+
+ private:
+  using Task = std::function<void()>;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Push(Task task);
+  bool TryPop(size_t index, Task& task);
+  bool RunPendingTask(size_t index);
+  void Work(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> pending_ = 0;
+  std::atomic<size_t> next_queue_ = 0;
+  bool stop_ = false;
+};
+
+template <typename Func>
+std::future<std::invoke_result_t<Func>> ThreadPool::Submit(Func func) {
+  auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Func>()>>(
+      std::move(func));
+  auto result = task->get_future();
+  Push([task] { (*task)(); });
+  return result;
+}
@@ -0,0 +1,127 @@
+#include "transfer_graph.h"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+namespace transpot_guide {
+
+TransferGraph::TransferGraph(const TransportCatalogue& catalogue)
+    : catalogue_(catalogue) {
+  const auto& stops = catalogue_.GetStopList();
+  const auto& buses = catalogue_.GetBusList();
+
+  std::unordered_map<std::string_view, uint32_t> bus_ids;
+  bus_ids.reserve(buses.size());
+  for (const Bus& bus : buses) {
+    bus_ids[bus.name_] = static_cast<uint32_t>(bus.id_);
+  }
+
+  // Автобусы каждой остановки
+  stop_bus_begin_.reserve(stops.size() + 1);
+  stop_bus_begin_.push_back(0);
+  for (const Stop& stop : stops) {
+    for (std::string_view bus : catalogue_.GetBusesOfStop(stop.name_)) {
+      stop_buses_.push_back(bus_ids.at(bus));
+    }
+    std::sort(stop_buses_.begin() + stop_bus_begin_.back(), stop_buses_.end());
+    stop_bus_begin_.push_back(static_cast<uint32_t>(stop_buses_.size()));
+  }
+
+  // Соседи автобуса — автобусы его остановок без повторов
+  std::vector<uint32_t> last_seen(buses.size(), NONE);
+  bus_begin_.reserve(buses.size() + 1);
+  bus_begin_.push_back(0);
+  for (const Bus& bus : buses) {
+    const auto id = static_cast<uint32_t>(bus.id_);
+    last_seen[id] = id;
+    for (const Stop* stop : bus.route_stops_) {
+      for (uint32_t i = stop_bus_begin_[stop->id_];
+           i < stop_bus_begin_[stop->id_ + 1]; ++i) {
+        const uint32_t other = stop_buses_[i];
+        if (last_seen[other] != id) {
+          last_seen[other] = id;
+          bus_neighbours_.push_back(other);
+        }
+      }
+    }
+    bus_begin_.push_back(static_cast<uint32_t>(bus_neighbours_.size()));
+  }
+}
+
+std::optional<std::vector<TransferGraph::Transfer>> TransferGraph::FindRoute(
+    const Stop* from, const Stop* to) const {
+  if (from == to) {
+    return std::vector<Transfer>{};
+  }
+
+  thread_local std::vector<uint32_t> parents;
+  thread_local std::vector<uint32_t> queue;
+  const size_t bus_count = bus_begin_.size() - 1;
+  parents.resize(bus_count, NONE);
+
+  // Корни обхода помечены сами собой
+  for (uint32_t i = stop_bus_begin_[from->id_];
+       i < stop_bus_begin_[from->id_ + 1]; ++i) {
+    parents[stop_buses_[i]] = stop_buses_[i];
+    queue.push_back(stop_buses_[i]);
+  }
+
+  uint32_t found = NONE;
+  for (size_t head = 0; head < queue.size() && found == NONE; ++head) {
+    const uint32_t bus = queue[head];
+    if (HasBus(to->id_, bus)) {
+      found = bus;
+      break;
+    }
+    for (uint32_t i = bus_begin_[bus]; i < bus_begin_[bus + 1]; ++i) {
+      const uint32_t next = bus_neighbours_[i];
+      if (parents[next] == NONE) {
+        parents[next] = bus;
+        queue.push_back(next);
+      }
+    }
+  }
+
+  std::optional<std::vector<Transfer>> route;
+  if (found != NONE) {
+    const auto& buses = catalogue_.GetBusList();
+    route.emplace();
+    for (uint32_t bus = found;; bus = parents[bus]) {
+      const bool is_first = parents[bus] == bus;
+      route->push_back({&buses[bus],
+                        is_first ? from : FindCommonStop(parents[bus], bus)});
+      if (is_first) {
+        break;
+      }
+    }
+    std::reverse(route->begin(), route->end());
+  }
+
+  // Помечены только автобусы из очереди
+  for (uint32_t bus : queue) {
+    parents[bus] = NONE;
+  }
+  queue.clear();
+  return route;
+}
+
+size_t TransferGraph::GetEdgeCount() const { return bus_neighbours_.size(); }
+
+const Stop* TransferGraph::FindCommonStop(uint32_t from_bus,
+                                          uint32_t to_bus) const {
+  for (const Stop* stop : catalogue_.GetBusList()[from_bus].route_stops_) {
+    if (HasBus(stop->id_, to_bus)) {
+      return stop;
+    }
+  }
+  return nullptr;
+}
+
+bool TransferGraph::HasBus(size_t stop, uint32_t bus) const {
+  return std::binary_search(stop_buses_.begin() + stop_bus_begin_[stop],
+                            stop_buses_.begin() + stop_bus_begin_[stop + 1],
+                            bus);
+}
+
+}  // namespace transpot_guide
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "domain.h"
+#include "transport_catalogue.h"
+
+namespace transpot_guide {
+
+// Граф пересадок: вершины — автобусы, два автобуса соседние, если у них
+// есть общая остановка. Строится по buses_of_stop_ заполненного каталога.
+// Маршрут с наименьшим числом пересадок ищется обходом в ширину от всех
+// автобусов начальной остановки сразу.
+class TransferGraph {
+ public:
+  struct Transfer {
+    const Bus* bus = nullptr;
+    const Stop* stop = nullptr;  // остановка посадки на bus
+  };
+
+  explicit TransferGraph(const TransportCatalogue& catalogue);
+
+  // Автобусы по порядку с остановками посадки; пусто при from == to,
+  // nullopt — если доехать нельзя
+  std::optional<std::vector<Transfer>> FindRoute(const Stop* from,
+                                                 const Stop* to) const;
+
+  size_t GetEdgeCount() const;
+
+ private:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  // Общая остановка двух автобусов
+  const Stop* FindCommonStop(uint32_t from_bus, uint32_t to_bus) const;
+
+  bool HasBus(size_t stop, uint32_t bus) const;
+
+  const TransportCatalogue& catalogue_;
+  // Списки смежности в виде CSR: соседи вершины v —
+  // [begin[v], begin[v + 1]) в массиве targets
+  std::vector<uint32_t> stop_bus_begin_;
+  std::vector<uint32_t> stop_buses_;  // по возрастанию внутри остановки
+  std::vector<uint32_t> bus_begin_;
+  std::vector<uint32_t> bus_neighbours_;
+};
+
+}  // namespace transpot_guide
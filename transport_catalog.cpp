@@ -1,10 +1,13 @@
 #include <iostream>
+#include <optional>
 
 #include "json.h"
 #include "json_reader.h"
 #include "request_handler.h"
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "transport_router.h"
+#include "thread_pool.h"
 using namespace std;
 
 
@@ -12,20 +15,51 @@ using namespace std;
 
 int main() {
   transpot_guide::TransportCatalogue transport_catologue;
+  ThreadPool pool;
   json::Document jsons = json::Load(std::cin);
   auto map_ = jsons.GetRoot().AsMap();
 
+  if (map_.count("catalogue_settings"s)) {
+    transport_catologue.SetSettings(::transpot_guide::input::ReadCatalogueSettings(
+        map_["catalogue_settings"s].AsMap()));
+  }
+
   ::transpot_guide::input::InputData(transport_catologue,
                                      map_["base_requests"s].AsArray());
+  transport_catologue.BuildWalkingLinks(pool);
   RenderSettings settings;
   if (map_.count("render_settings"s)) {
       settings = ::transpot_guide::input::ReadRenderSettings(map_["render_settings"s].AsMap());
   }
+  MapRenderer renderer(std::move(settings), &pool);
+
+  std::optional<transpot_guide::TransportRouter> router;
+  if (map_.count("routing_settings"s)) {
+    router.emplace(transport_catologue,
+                   ::transpot_guide::input::ReadRoutingSettings(
+                       map_["routing_settings"s].AsMap()),
+                   &pool);
+  }
 
-  json::Document a(transpot_guide::output::OutputData(
-      transport_catologue, map_["stat_requests"].AsArray(), settings));
+  transpot_guide::output::ExecutionSettings execution;
+  if (map_.count("execution_settings"s)) {
+    execution = ::transpot_guide::input::ReadExecutionSettings(
+        map_["execution_settings"s].AsMap());
+  }
+  // По умолчанию запросы идут в общий pool, свой пул заводится только
+  // под заданное число потоков и пакет больше одного запроса
+  const auto& stat_requests = map_["stat_requests"s].AsArray();
+  std::optional<ThreadPool> executor;
+  ThreadPool* request_pool = nullptr;
+  if (execution.threads == 0) {
+    request_pool = &pool;
+  } else if (execution.threads > 1 && stat_requests.size() > 1) {
+    request_pool = &executor.emplace(execution.threads);
+  }
 
-  json::Print(a, cout);
+  transpot_guide::output::OutputData(
+      transport_catologue, stat_requests, renderer,
+      router ? &*router : nullptr, cout, request_pool);
 //  cout << endl;
 
 //  cout << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n  <polyline points=\"100.817,170 30,30 100.817,170\" fill=\"none\" stroke=\"green\" stroke-width=\"14\" stroke-linecap=\"round\" stroke-linejoin=\"round\"/>\n  <text fill=\"rgba(255,255,255,0.85)\" stroke=\"rgba(255,255,255,0.85)\" stroke-width=\"3\" stroke-linecap=\"round\" stroke-linejoin=\"round\" x=\"100.817\" y=\"170\" dx=\"7\" dy=\"15\" font-size=\"20\" font-family=\"Verdana\" font-weight=\"bold\">114</text>\n  <text fill=\"green\" x=\"100.817\" y=\"170\" dx=\"7\" dy=\"15\" font-size=\"20\" font-family=\"Verdana\" font-weight=\"bold\">114</text>\n  <text fill=\"rgba(255,255,255,0.85)\" stroke=\"rgba(255,255,255,0.85)\" stroke-width=\"3\" stroke-linecap=\"round\" stroke-linejoin=\"round\" x=\"30\" y=\"30\" dx=\"7\" dy=\"15\" font-size=\"20\" font-family=\"Verdana\" font-weight=\"bold\">114</text>\n  <text fill=\"green\" x=\"30\" y=\"30\" dx=\"7\" dy=\"15\" font-size=\"20\" font-family=\"Verdana\" font-weight=\"bold\">114</text>\n  <circle cx=\"100.817\" cy=\"170\" r=\"5\" fill=\"white\"/>\n  <circle cx=\"30\" cy=\"30\" r=\"5\" fill=\"white\"/>\n  <text fill=\"rgba(255,255,255,0.85)\" stroke=\"rgba(255,255,255,0.85)\" stroke-width=\"3\" stroke-linecap=\"round\" stroke-linejoin=\"round\" x=\"100.817\" y=\"170\" dx=\"7\" dy=\"-3\" font-size=\"20\" font-family=\"Verdana\">Морской вокзал</text>\n  <text fill=\"black\" x=\"100.817\" y=\"170\" dx=\"7\" dy=\"-3\" font-size=\"20\" font-family=\"Verdana\">Морской вокзал</text>\n  <text fill=\"rgba(255,255,255,0.85)\" stroke=\"rgba(255,255,255,0.85)\" stroke-width=\"3\" stroke-linecap=\"round\" stroke-linejoin=\"round\" x=\"30\" y=\"30\" dx=\"7\" dy=\"-3\" font-size=\"20\" font-family=\"Verdana\">Ривьерский мост</text>\n  <text fill=\"black\" x=\"30\" y=\"30\" dx=\"7\" dy=\"-3\" font-size=\"20\" font-family=\"Verdana\">Ривьерский мост</text>\n</svg>" << endl;
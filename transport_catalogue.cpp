@@ -1,23 +1,45 @@
 #include "transport_catalogue.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <deque>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <utility>
 
 using namespace std::string_literals;
 
 namespace transpot_guide {
+namespace {
+// Ключ ячейки сетки: строка в старших битах, чтобы соседи по строке
+// шли подряд
+uint64_t GetCellKey(int32_t row, int32_t column) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(row)) << 32) |
+         static_cast<uint32_t>(column);
+}
+}  // namespace
+
+void TransportCatalogue::SetSettings(CatalogueSettings settings) {
+  settings_ = std::move(settings);
+  ++revision_;
+}
+
+double TransportCatalogue::ComputeGeoDistance(const Stop* from,
+                                              const Stop* to) const {
+  return detail::ComputeDistance(from->GetCoordinates(), to->GetCoordinates(),
+                                 settings_.distance_model);
+}
+
 void TransportCatalogue::AddStop(std::string stop_name, double latitude,
                                  double longitude) {
   stops_.push_back({std::move(stop_name),
-                    {std::move(latitude),
-                     std::move(longitude)}});  /// для double излишне делать
-                                               /// std::move, но можете оставить
+                    detail::ToStored({latitude, longitude}), stops_.size()});
   stop_coordinate_[stops_.back().name_] = &stops_.back();
+  ++revision_;
 }
 
 void TransportCatalogue::AddDistance(std::string stop_from, std::string stop_to,
@@ -25,6 +47,7 @@ void TransportCatalogue::AddDistance(std::string stop_from, std::string stop_to,
   Stop* from = FindStop(stop_from);
   Stop* to = FindStop(stop_to);
   lengh_btw_stop_[std::make_pair(from, to)] = dist;
+  ++revision_;
 }
 
 void TransportCatalogue::AddRoute(std::string bus,
@@ -44,70 +67,140 @@ void TransportCatalogue::AddRoute(std::string bus,
   int unique_stops =
       std::unordered_set<std::string>{stops.begin(), stops.end()}.size();
 
-  double direct_lengh = 0;
-
-  for (auto itr = stops_ref.begin(); itr < stops_ref.end() - 1; ++itr) {
-    Stop* from = *itr;
-    Stop* to = *(itr + 1);
-    direct_lengh += ComputeDistance(from->coordinates_, to->coordinates_);
+  // Рейс целиком: туда и, для некольцевого, обратно
+  // Автобус без остановок допустим во входных данных, его длина нулевая
+  std::vector<Stop*> trip{stops_ref.begin(), stops_ref.end()};
+  if (!is_roundtrip && !trip.empty()) {
+    trip.insert(trip.end(), stops_ref.rbegin() + 1, stops_ref.rend());
   }
-
-  if (!is_roundtrip) {
-    for (auto itr = stops_ref.rbegin(); itr < stops_ref.rend() - 1; ++itr) {
-      Stop* from = *itr;
-      Stop* to = *(itr + 1);
-      direct_lengh += ComputeDistance(from->coordinates_, to->coordinates_);
-    }
-  }
-
-  double real_lengh = 0;
-  for (auto itr = stops_ref.begin(); itr < stops_ref.end() - 1; ++itr) {
-    Stop* from = *itr;
-    Stop* to = *(itr + 1);
-    if (lengh_btw_stop_.count(std::make_pair(from, to))) {
-      real_lengh += lengh_btw_stop_[std::make_pair(from, to)];
-    } else if (lengh_btw_stop_.count(std::make_pair(to, from))) {
-      real_lengh += lengh_btw_stop_[std::make_pair(to, from)];
-    } else {
-      real_lengh += ComputeDistance(from->coordinates_, to->coordinates_);
-    }
-  }
-
-  if (!is_roundtrip) {
-    for (auto itr = stops_ref.rbegin(); itr < stops_ref.rend() - 1; ++itr) {
-      Stop* from = *itr;
-      Stop* to = *(itr + 1);
-      if (lengh_btw_stop_.count(std::make_pair(from, to))) {
-        real_lengh += lengh_btw_stop_[std::make_pair(from, to)];
-      } else if (lengh_btw_stop_.count(std::make_pair(to, from))) {
-        real_lengh += lengh_btw_stop_[std::make_pair(to, from)];
-      } else {
-        real_lengh += ComputeDistance(from->coordinates_, to->coordinates_);
-      }
-    }
+  std::vector<double> road_prefix(trip.size(), 0);
+  std::vector<double> geo_prefix(trip.size(), 0);
+  for (size_t i = 1; i < trip.size(); ++i) {
+    road_prefix[i] = road_prefix[i - 1] + GetRoadDistance(trip[i - 1], trip[i]);
+    geo_prefix[i] = geo_prefix[i - 1] + ComputeGeoDistance(trip[i - 1], trip[i]);
   }
+  double real_lengh = trip.empty() ? 0 : road_prefix.back();
+  double direct_lengh = trip.empty() ? 0 : geo_prefix.back();
 
   buses_.push_back({std::move(bus), std::move(stops_ref),
                     std::move(stops_on_route), std::move(unique_stops),
                     std::move(real_lengh), real_lengh / direct_lengh,
-                    is_roundtrip});
+                    is_roundtrip, buses_.size(), std::move(road_prefix),
+                    std::move(geo_prefix)});
+  const Bus* added = &buses_.back();
+
+  std::vector<std::pair<Stop*, uint32_t>> stop_positions;
+  for (uint32_t i = 0; i < trip.size(); ++i) {
+    stop_positions.push_back({trip[i], i});
+  }
+  std::sort(stop_positions.begin(), stop_positions.end());
+  for (size_t i = 0; i < stop_positions.size(); ++i) {
+    StopPositions& range = stop_positions_[{stop_positions[i].first, added}];
+    if (i == 0 || stop_positions[i].first != stop_positions[i - 1].first) {
+      range = {static_cast<uint32_t>(positions_.size()), 0};
+    }
+    positions_.push_back(stop_positions[i].second);
+    ++range.count;
+  }
   routes_[buses_.back().name_] = &buses_.back();
   for (Stop* stop : buses_.back().route_stops_) {
     buses_of_stop_[stop->name_].insert(buses_.back().name_);
   }
+  ++revision_;
+}
+
+double TransportCatalogue::GetRoadDistance(const Stop* from,
+                                           const Stop* to) const {
+  auto key = std::make_pair(const_cast<Stop*>(from), const_cast<Stop*>(to));
+  if (auto itr = lengh_btw_stop_.find(key); itr != lengh_btw_stop_.end()) {
+    return itr->second;
+  }
+  std::swap(key.first, key.second);
+  if (auto itr = lengh_btw_stop_.find(key); itr != lengh_btw_stop_.end()) {
+    return itr->second;
+  }
+  return ComputeGeoDistance(from, to);
+}
+
+std::optional<SegmentInfo> TransportCatalogue::GetSegment(
+    const Bus* bus, const Stop* from, const Stop* to) const {
+  if (bus->road_prefix_.empty()) {
+    return std::nullopt;
+  }
+  auto from_itr = stop_positions_.find({from, bus});
+  auto to_itr = stop_positions_.find({to, bus});
+  if (from_itr == stop_positions_.end() || to_itr == stop_positions_.end()) {
+    return std::nullopt;
+  }
+  if (from == to) {
+    return SegmentInfo{};
+  }
+
+  const auto from_begin = positions_.begin() + from_itr->second.begin;
+  const auto from_end = from_begin + from_itr->second.count;
+  const auto to_begin = positions_.begin() + to_itr->second.begin;
+  const auto to_end = to_begin + to_itr->second.count;
+  const uint32_t last = bus->road_prefix_.size() - 1;
+
+  // Для каждого прохода через from — ближайший следующий проход через to
+  uint32_t best_from = 0;
+  uint32_t best_to = 0;
+  uint32_t best_span = UINT32_MAX;
+  for (auto itr = from_begin; itr != from_end; ++itr) {
+    auto next = std::upper_bound(to_begin, to_end, *itr);
+    uint32_t span;
+    uint32_t to_position;
+    if (next != to_end) {
+      to_position = *next;
+      span = to_position - *itr;
+    } else if (bus->is_roundtrip) {
+      // Через конечную: она же начальная
+      to_position = *to_begin;
+      span = last - *itr + to_position;
+    } else {
+      continue;
+    }
+    if (span < best_span) {
+      best_span = span;
+      best_from = *itr;
+      best_to = to_position;
+    }
+  }
+  if (best_span == UINT32_MAX) {
+    return std::nullopt;
+  }
+
+  auto length = [&](const std::vector<double>& prefix) {
+    return best_from <= best_to
+               ? prefix[best_to] - prefix[best_from]
+               : prefix[last] - prefix[best_from] + prefix[best_to];
+  };
+  return SegmentInfo{static_cast<int>(best_span), length(bus->road_prefix_),
+                     length(bus->geo_prefix_)};
 }
 
+// Поиск без вставки: ответы на запросы читают каталог из нескольких
+// потоков
 Bus* TransportCatalogue::FindRoute(std::string_view bus) {
-  return routes_[bus];
+  auto itr = routes_.find(bus);
+  return itr == routes_.end() ? nullptr : itr->second;
 }
 
 Stop* TransportCatalogue::FindStop(std::string_view stop) {
-  return stop_coordinate_[stop];
+  auto itr = stop_coordinate_.find(stop);
+  return itr == stop_coordinate_.end() ? nullptr : itr->second;
 }
 
 std::set<std::string_view> TransportCatalogue::GetBusofStop(
     std::string_view stop) {
-  return buses_of_stop_[stop];
+  return GetBusesOfStop(stop);
+}
+
+const std::set<std::string_view>& TransportCatalogue::GetBusesOfStop(
+    std::string_view stop) const {
+  static const std::set<std::string_view> empty;
+  auto itr = buses_of_stop_.find(stop);
+  return itr == buses_of_stop_.end() ? empty : itr->second;
 }
 
 bool TransportCatalogue::IsBus(std::string_view bus) const {
@@ -135,4 +228,135 @@ std::deque<Bus*> TransportCatalogue::GetBus() {
   return buses;
 }
 
+void TransportCatalogue::BuildWalkingLinks(ThreadPool& pool) {
+  const double radius = settings_.walking_radius;
+  if (radius <= 0) {
+    return;
+  }
+  walk_begin_.assign(stops_.size() + 1, 0);
+  walk_links_.clear();
+  if (stops_.empty()) {
+    return;
+  }
+
+  // Ячейка по долготе берётся по самой высокой широте, чтобы её ширина
+  // была не меньше радиуса на всех широтах
+  double max_latitude = 0;
+  for (const Stop& stop : stops_) {
+    max_latitude = std::max(max_latitude, std::abs(stop.GetCoordinates().lat));
+  }
+  const double lat_step = radius / detail::GetDegreeLength();
+  const double lng_step =
+      lat_step / std::cos(std::min(max_latitude + lat_step, 89.) *
+                          detail::DEGREE_TO_RADIAN);
+
+  struct Cell {
+    uint64_t key;
+    uint32_t stop;
+  };
+  std::vector<Cell> cells;
+  cells.reserve(stops_.size());
+  for (const Stop& stop : stops_) {
+    const auto coordinates = stop.GetCoordinates();
+    cells.push_back(
+        {GetCellKey(static_cast<int32_t>(std::floor(coordinates.lat / lat_step)),
+                    static_cast<int32_t>(std::floor(coordinates.lng / lng_step))),
+         static_cast<uint32_t>(stop.id_)});
+  }
+  std::sort(cells.begin(), cells.end(), [](const Cell& lhs, const Cell& rhs) {
+    return std::tie(lhs.key, lhs.stop) < std::tie(rhs.key, rhs.stop);
+  });
+  // Начала непустых ячеек в cells
+  std::vector<uint32_t> cell_begin;
+  for (uint32_t i = 0; i < cells.size(); ++i) {
+    if (i == 0 || cells[i].key != cells[i - 1].key) {
+      cell_begin.push_back(i);
+    }
+  }
+  cell_begin.push_back(static_cast<uint32_t>(cells.size()));
+
+  // Каждая ячейка ищет соседей своих остановок и пишет в свой буфер,
+  // поэтому потокам не нужна синхронизация
+  std::vector<std::vector<std::pair<uint32_t, WalkingLink>>> found(
+      cell_begin.size() - 1);
+  pool.ParallelFor(
+      0, found.size(),
+      [&](size_t cell) {
+        const uint64_t key = cells[cell_begin[cell]].key;
+        const auto row = static_cast<int32_t>(key >> 32);
+        const auto column = static_cast<int32_t>(key & UINT32_MAX);
+        for (int32_t row_shift = -1; row_shift <= 1; ++row_shift) {
+          for (int32_t column_shift = -1; column_shift <= 1; ++column_shift) {
+            const uint64_t other_key =
+                GetCellKey(row + row_shift, column + column_shift);
+            auto other = std::lower_bound(
+                cells.begin(), cells.end(), other_key,
+                [](const Cell& lhs, uint64_t rhs) { return lhs.key < rhs; });
+            for (; other != cells.end() && other->key == other_key; ++other) {
+              const Stop* to = &stops_[other->stop];
+              for (uint32_t i = cell_begin[cell]; i < cell_begin[cell + 1];
+                   ++i) {
+                const Stop* from = &stops_[cells[i].stop];
+                if (from == to) {
+                  continue;
+                }
+                const double distance = ComputeGeoDistance(from, to);
+                if (distance <= radius) {
+                  found[cell].push_back({cells[i].stop, {to, distance}});
+                }
+              }
+            }
+          }
+        }
+      },
+      64);
+
+  for (const auto& links : found) {
+    for (const auto& [from, link] : links) {
+      ++walk_begin_[from + 1];
+    }
+  }
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    walk_begin_[i + 1] += walk_begin_[i];
+  }
+  walk_links_.resize(walk_begin_.back(), {nullptr, 0});
+  std::vector<uint32_t> filled(walk_begin_.begin(), walk_begin_.end() - 1);
+  for (const auto& links : found) {
+    for (const auto& [from, link] : links) {
+      walk_links_[filled[from]++] = link;
+    }
+  }
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    std::sort(walk_links_.begin() + walk_begin_[i],
+              walk_links_.begin() + walk_begin_[i + 1],
+              [](const WalkingLink& lhs, const WalkingLink& rhs) {
+                return std::tie(lhs.distance, lhs.stop->id_) <
+                       std::tie(rhs.distance, rhs.stop->id_);
+              });
+  }
+}
+
+graph::Range<std::vector<WalkingLink>::const_iterator>
+TransportCatalogue::GetWalkingLinks(const Stop* stop) const {
+  if (walk_begin_.empty()) {
+    return {walk_links_.end(), walk_links_.end()};
+  }
+  return {walk_links_.begin() + walk_begin_[stop->id_],
+          walk_links_.begin() + walk_begin_[stop->id_ + 1]};
+}
+
+bool TransportCatalogue::HasWalkingLinks() const {
+  return !walk_begin_.empty();
+}
+
+const std::deque<Stop>& TransportCatalogue::GetStopList() const {
+  return stops_;
+}
+
+const std::deque<Bus>& TransportCatalogue::GetBusList() const {
+  return buses_;
+}
+
+uint64_t TransportCatalogue::GetRevision() const { return revision_; }
+
 }  // namespace transpot_guide
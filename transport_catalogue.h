@@ -3,6 +3,7 @@
 #include <deque>
 #include <functional>
 #include <iostream>
+#include <optional>
 #include <set>
 #include <string>
 #include <string_view>
@@ -12,17 +13,65 @@
 
 #include "domain.h"
 #include "geo.h"
+#include "graph.h"
+#include "thread_pool.h"
 
 namespace transpot_guide {
 
+struct CatalogueSettings {
+  detail::DistanceModel distance_model = detail::DistanceModel::EXACT;
+  // Остановки ближе этого расстояния (м) связываются пешими переходами;
+  // 0 — переходы не ищутся
+  double walking_radius = 0;
+};
+
+// Участок рейса автобуса между двумя остановками
+struct SegmentInfo {
+  int span_count = 0;
+  double road_length = 0;  // м
+  double geo_length = 0;   // м
+};
+
+struct WalkingLink {
+  const Stop* stop;
+  double distance;  // м
+};
+
 class TransportCatalogue {
  public:
+  // Настройки применяются к маршрутам, добавленным после вызова
+  void SetSettings(CatalogueSettings settings);
+
   void AddStop(std::string stop_name, double latitude, double longitude);
 
   void AddRoute(std::string bus, std::vector<std::string> stops, bool is_roundtrip);
 
   void AddDistance(std::string stop_from, std::string stop_to, int dist);
 
+  // Ищет пары остановок не дальше settings.walking_radius друг от друга.
+  // Вызывается после добавления всех остановок. Остановки раскладываются
+  // по сетке с ячейкой не меньше радиуса, и каждая ячейка сравнивается
+  // только с восемью соседними; ячейки обрабатываются в пуле.
+  void BuildWalkingLinks(ThreadPool& pool);
+
+  // Соседи по пешим переходам в порядке возрастания расстояния
+  graph::Range<std::vector<WalkingLink>::const_iterator> GetWalkingLinks(
+      const Stop* stop) const;
+
+  // true, если BuildWalkingLinks вызывался с ненулевым радиусом
+  bool HasWalkingLinks() const;
+
+  // Дорожное расстояние между соседними остановками; если оно не задано
+  // ни в одну сторону, используется географическое
+  double GetRoadDistance(const Stop* from, const Stop* to) const;
+
+  // Участок рейса bus от from до ближайшего следующего прохода через to
+  // (кольцевой рейс может перейти через конечную). Считается за O(1) по
+  // префиксным суммам, если остановки встречаются в рейсе по разу.
+  // nullopt, если одной из остановок нет в рейсе.
+  std::optional<SegmentInfo> GetSegment(const Bus* bus, const Stop* from,
+                                        const Stop* to) const;
+
   Bus* FindRoute(std::string_view state);
 
   Stop* FindStop(std::string_view state);
@@ -33,11 +82,27 @@ class TransportCatalogue {
 
   std::set<std::string_view> GetBusofStop(std::string_view stop);
 
+  // Без копирования; для неизвестной остановки — пустое множество
+  const std::set<std::string_view>& GetBusesOfStop(std::string_view stop) const;
+
   std::deque<Stop*> GetStops();
 
   std::deque<Bus*> GetBus();
 
+  // Все остановки в порядке добавления, индекс совпадает с Stop::id_
+  const std::deque<Stop>& GetStopList() const;
+
+  // Все автобусы в порядке добавления, индекс совпадает с Bus::id_
+  const std::deque<Bus>& GetBusList() const;
+
+  // Растёт при каждом изменении каталога; по ней сбрасываются кэши
+  uint64_t GetRevision() const;
+
  private:
+  double ComputeGeoDistance(const Stop* from, const Stop* to) const;
+
+  CatalogueSettings settings_;
+  uint64_t revision_ = 0;
   std::deque<Stop> stops_;
   std::deque<Bus> buses_;
   std::unordered_map<std::string_view, Bus*> routes_;
@@ -46,5 +111,18 @@ class TransportCatalogue {
       buses_of_stop_;
   std::unordered_map<std::pair<Stop*, Stop*>, int, PairStopHash>
       lengh_btw_stop_;
+  // Позиции остановки в рейсе автобуса — count элементов positions_
+  // начиная с begin, по возрастанию
+  struct StopPositions {
+    uint32_t begin;
+    uint32_t count;
+  };
+  std::unordered_map<std::pair<const Stop*, const void*>, StopPositions,
+                     StopBusHash>
+      stop_positions_;
+  std::vector<uint32_t> positions_;
+  // Переходы остановки с id i — [walk_begin_[i], walk_begin_[i + 1])
+  std::vector<uint32_t> walk_begin_;
+  std::vector<WalkingLink> walk_links_;
 };
 }  // namespace transpot_guide
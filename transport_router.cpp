@@ -0,0 +1,324 @@
+#include "transport_router.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+namespace transpot_guide {
+namespace {
+// км/ч -> м/мин
+double ToMetersPerMinute(double velocity) { return velocity * 1000. / 60.; }
+
+// FNV-1a
+void HashBytes(uint64_t& hash, const void* data, size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+
+template <typename T>
+void HashValue(uint64_t& hash, T value) {
+  HashBytes(hash, &value, sizeof(value));
+}
+}  // namespace
+
+TransportRouter::TransportRouter(const TransportCatalogue& catalogue,
+                                 RoutingSettings settings, ThreadPool* pool)
+    : catalogue_(catalogue),
+      settings_(std::move(settings)),
+      graph_(CountVertices(catalogue)),
+      next_vertex_(catalogue.GetStopList().size()),
+      router_(graph_),
+      pool_(pool) {
+  for (const Stop& stop : catalogue_.GetStopList()) {
+    vertex_stops_.push_back(&stop);
+    stop_points_.push_back(detail::ToSpherePoint(stop.GetCoordinates()));
+  }
+  heuristic_scale_ = 1. / ToMetersPerMinute(settings_.bus_velocity);
+
+  for (const Bus& bus : catalogue_.GetBusList()) {
+    std::vector<const Stop*> stops{bus.route_stops_.begin(),
+                                   bus.route_stops_.end()};
+    AddBusEdges(bus, stops);
+    if (!bus.is_roundtrip) {
+      AddBusEdges(bus, {stops.rbegin(), stops.rend()});
+    }
+  }
+
+  if (settings_.search_mode == SearchMode::CONTRACTION_HIERARCHIES) {
+    hierarchy_.emplace(graph_);
+  }
+  if (settings_.precompute_journeys) {
+    PrepareJourneyTable(pool);
+  }
+}
+
+size_t TransportRouter::CountVertices(const TransportCatalogue& catalogue) {
+  size_t count = catalogue.GetStopList().size();
+  for (const Bus& bus : catalogue.GetBusList()) {
+    count += bus.route_stops_.size() * (bus.is_roundtrip ? 1 : 2);
+  }
+  return count;
+}
+
+void TransportRouter::AddBusEdges(const Bus& bus,
+                                  const std::vector<const Stop*>& stops) {
+  const double velocity = ToMetersPerMinute(settings_.bus_velocity);
+  const double wait_time = settings_.bus_wait_time;
+  for (size_t i = 0; i < stops.size(); ++i) {
+    const graph::VertexId position = next_vertex_ + i;
+    graph_.AddEdge({stops[i]->id_, position, wait_time});
+    edges_info_.push_back({EdgeKind::BOARD, stops[i], &bus});
+    graph_.AddEdge({position, stops[i]->id_, 0});
+    edges_info_.push_back({EdgeKind::ALIGHT, stops[i], &bus});
+    vertex_stops_.push_back(stops[i]);
+    if (i + 1 < stops.size()) {
+      const double distance =
+          catalogue_.GetRoadDistance(stops[i], stops[i + 1]);
+      graph_.AddEdge({position, position + 1, distance / velocity});
+      edges_info_.push_back({EdgeKind::RIDE, stops[i], &bus});
+
+      const double direct = detail::ComputeDistance(
+          stops[i]->GetCoordinates(), stops[i + 1]->GetCoordinates());
+      if (direct > 0 && distance < direct) {
+        heuristic_scale_ =
+            std::min(heuristic_scale_, distance / direct / velocity);
+      }
+    }
+  }
+  next_vertex_ += stops.size();
+}
+
+uint64_t TransportRouter::ComputeFingerprint() const {
+  uint64_t hash = 14695981039346656037ull;
+  HashValue<uint64_t>(hash, catalogue_.GetStopList().size());
+  HashValue<uint64_t>(hash, graph_.GetVertexCount());
+  for (graph::EdgeId id = 0; id < graph_.GetEdgeCount(); ++id) {
+    const auto& edge = graph_.GetEdge(id);
+    uint64_t weight_bits;
+    std::memcpy(&weight_bits, &edge.weight, sizeof(weight_bits));
+    HashValue<uint64_t>(hash, edge.from);
+    HashValue<uint64_t>(hash, edge.to);
+    HashValue(hash, weight_bits);
+  }
+  return hash;
+}
+
+void TransportRouter::PrepareJourneyTable(ThreadPool* pool) {
+  const uint64_t fingerprint = ComputeFingerprint();
+  if (!settings_.journey_table_file.empty()) {
+    std::ifstream input(settings_.journey_table_file, std::ios::binary);
+    if (input) {
+      journey_table_ = JourneyTable::Load(input, fingerprint, graph_,
+                                          catalogue_.GetStopList().size());
+      if (journey_table_) {
+        return;
+      }
+    }
+  }
+
+  std::optional<ThreadPool> own_pool;
+  if (!pool) {
+    pool = &own_pool.emplace();
+  }
+  // Без таблицы маршруты ищутся по графу
+  journey_table_ = JourneyTable::Build(
+      router_, catalogue_.GetStopList().size(), *pool);
+
+  if (journey_table_ && !settings_.journey_table_file.empty()) {
+    // Через временный файл, чтобы при ошибке записи не остался обрезанный
+    // файл с верным заголовком
+    const std::string temp_file = settings_.journey_table_file + ".tmp";
+    bool saved;
+    {
+      std::ofstream output(temp_file, std::ios::binary);
+      saved = output && journey_table_->Save(output, fingerprint);
+      output.close();
+      saved = saved && !output.fail();
+    }
+    if (!saved ||
+        std::rename(temp_file.c_str(),
+                    settings_.journey_table_file.c_str()) != 0) {
+      std::remove(temp_file.c_str());
+    }
+  }
+}
+
+std::optional<RouteResult> TransportRouter::BuildTableRoute(
+    const Stop* from, const Stop* to) const {
+  const auto legs = journey_table_->GetLegs(from->id_, to->id_);
+  if (!legs) {
+    return std::nullopt;
+  }
+  // Время складывается в том же порядке, что и при поиске по графу,
+  // поэтому total_time совпадает с ответом Дейкстры до бита
+  RouteResult result;
+  const double wait_time = settings_.bus_wait_time;
+  for (const JourneyTable::Leg& leg : *legs) {
+    result.total_time += wait_time;
+    const Stop* stop = vertex_stops_[leg.board];
+    result.items.push_back({stop, nullptr, 0, wait_time});
+
+    RouteItem ride{stop, nullptr, static_cast<int>(leg.span_count), 0};
+    graph::VertexId position = leg.board;
+    for (size_t i = 0; i < leg.span_count; ++i, ++position) {
+      for (graph::EdgeId edge : graph_.GetIncidentEdges(position)) {
+        if (graph_.GetEdge(edge).to == position + 1) {
+          const double time = graph_.GetEdge(edge).weight;
+          ride.bus = edges_info_[edge].bus;
+          ride.time += time;
+          result.total_time += time;
+          break;
+        }
+      }
+    }
+    result.items.push_back(ride);
+  }
+  return result;
+}
+
+std::optional<RouteResult> TransportRouter::BuildRoute(const Stop* from,
+                                                       const Stop* to) const {
+  if (journey_table_) {
+    return BuildTableRoute(from, to);
+  }
+  graph::Router<double>::SearchStats stats;
+  std::optional<graph::Router<double>::RouteInfo> route;
+  switch (settings_.search_mode) {
+    case SearchMode::DIJKSTRA:
+      route = router_.BuildRoute(from->id_, to->id_, &stats);
+      break;
+    case SearchMode::ASTAR: {
+      // С остановки, отличной от цели, не уехать без хотя бы одного ожидания
+      const detail::SpherePoint target = stop_points_[to->id_];
+      const size_t stop_count = catalogue_.GetStopList().size();
+      const double wait_time = settings_.bus_wait_time;
+      route = router_.BuildRoute(
+          from->id_, to->id_,
+          [&, target](graph::VertexId vertex) {
+            const double estimate =
+                detail::ComputeChordDistance(
+                    stop_points_[vertex_stops_[vertex]->id_], target) *
+                heuristic_scale_;
+            return vertex < stop_count && vertex != to->id_
+                       ? estimate + wait_time
+                       : estimate;
+          },
+          &stats);
+      break;
+    }
+    case SearchMode::CONTRACTION_HIERARCHIES:
+      route = hierarchy_->BuildRoute(from->id_, to->id_);
+      break;
+  }
+  if (!route) {
+    return std::nullopt;
+  }
+  RouteResult result;
+  result.total_time = route->weight;
+  result.expanded_vertices = stats.expanded_vertices;
+  RouteItem ride;
+  for (graph::EdgeId edge : route->edges) {
+    const EdgeInfo& info = edges_info_[edge];
+    const double time = graph_.GetEdge(edge).weight;
+    switch (info.kind) {
+      case EdgeKind::BOARD:
+        result.items.push_back({info.stop, nullptr, 0, time});
+        ride = {info.stop, info.bus, 0, 0};
+        break;
+      case EdgeKind::RIDE:
+        ++ride.span_count;
+        ride.time += time;
+        break;
+      case EdgeKind::ALIGHT:
+        result.items.push_back(ride);
+        break;
+    }
+  }
+  return result;
+}
+
+void TransportRouter::FindReachable(const Stop* from, double time_limit,
+                                    std::vector<ReachableStop>& result) const {
+  result.clear();
+  const size_t stop_count = catalogue_.GetStopList().size();
+  router_.Explore(
+      from->id_,
+      [&](graph::VertexId vertex, double weight, graph::EdgeId) {
+        if (vertex < stop_count) {
+          result.push_back({vertex_stops_[vertex], weight});
+        }
+      },
+      time_limit);
+}
+
+std::vector<std::optional<double>> TransportRouter::ComputeMatrix(
+    const std::vector<const Stop*>& sources,
+    const std::vector<const Stop*>& targets) const {
+  const size_t column_count = targets.size();
+  std::vector<std::optional<double>> result(sources.size() * column_count);
+
+  // Для остановки — первый столбец с ней; повторы копируются в конце
+  constexpr size_t NO_COLUMN = std::numeric_limits<size_t>::max();
+  std::vector<size_t> stop_columns(catalogue_.GetStopList().size(), NO_COLUMN);
+  std::vector<size_t> canonical(column_count);
+  size_t unique_count = 0;
+  for (size_t j = 0; j < column_count; ++j) {
+    size_t& column = stop_columns[targets[j]->id_];
+    if (column == NO_COLUMN) {
+      column = j;
+      ++unique_count;
+    }
+    canonical[j] = column;
+  }
+
+  const size_t stop_count = catalogue_.GetStopList().size();
+  auto compute_row = [&](size_t i) {
+    std::optional<double>* row = result.data() + i * column_count;
+    size_t remaining = unique_count;
+    router_.Explore(sources[i]->id_, [&](graph::VertexId vertex, double weight,
+                                         graph::EdgeId) {
+      if (vertex < stop_count && stop_columns[vertex] != NO_COLUMN) {
+        row[stop_columns[vertex]] = weight;
+        --remaining;
+      }
+      return remaining > 0;
+    });
+    for (size_t j = 0; j < column_count; ++j) {
+      row[j] = row[canonical[j]];
+    }
+  };
+
+  if (pool_) {
+    pool_->ParallelFor(0, sources.size(), compute_row);
+  } else {
+    for (size_t i = 0; i < sources.size(); ++i) {
+      compute_row(i);
+    }
+  }
+  return result;
+}
+
+const RoutingSettings& TransportRouter::GetSettings() const {
+  return settings_;
+}
+
+const graph::DirectedWeightedGraph<double>& TransportRouter::GetGraph() const {
+  return graph_;
+}
+
+const graph::ContractionHierarchy<double>* TransportRouter::GetHierarchy()
+    const {
+  return hierarchy_ ? &*hierarchy_ : nullptr;
+}
+
+const JourneyTable* TransportRouter::GetJourneyTable() const {
+  return journey_table_ ? &*journey_table_ : nullptr;
+}
+
+}  // namespace transpot_guide
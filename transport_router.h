@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "contraction_hierarchy.h"
+#include "domain.h"
+#include "graph.h"
+#include "journey_table.h"
+#include "router.h"
+#include "thread_pool.h"
+#include "transport_catalogue.h"
+
+namespace transpot_guide {
+
+enum class SearchMode { DIJKSTRA, ASTAR, CONTRACTION_HIERARCHIES };
+
+struct RoutingSettings {
+  int bus_wait_time = 0;    // минуты
+  double bus_velocity = 0;  // км/ч
+  SearchMode search_mode = SearchMode::DIJKSTRA;
+  // Добавлять в ответ Route число раскрытых вершин (DIJKSTRA и ASTAR)
+  bool report_expansions = false;
+  // Посчитать маршруты между всеми парами остановок при построении.
+  // Если задан journey_table_file, таблица читается из него, а при
+  // несовпадении с графом пересчитывается и записывается заново.
+  bool precompute_journeys = false;
+  std::string journey_table_file;
+};
+
+// Один шаг маршрута: ожидание на остановке (bus == nullptr)
+// или поездка на автобусе через span_count перегонов
+struct RouteItem {
+  const Stop* stop = nullptr;
+  const Bus* bus = nullptr;
+  int span_count = 0;
+  double time = 0;
+};
+
+struct RouteResult {
+  double total_time = 0;
+  std::vector<RouteItem> items;
+  size_t expanded_vertices = 0;
+};
+
+// Остановка, до которой можно добраться, и время в пути до неё
+struct ReachableStop {
+  const Stop* stop = nullptr;
+  double time = 0;
+};
+
+// Граф строится один раз по заполненному каталогу.
+// Вершина id остановки — прибытие на неё. Каждая позиция каждого направления
+// автобуса — отдельная вершина «в автобусе». Рёбра: посадка (прибытие ->
+// позиция, bus_wait_time), перегон (позиция -> следующая позиция, время в
+// пути) и высадка (позиция -> прибытие, 0). Граф разреженный: число рёбер
+// линейно по суммарной длине маршрутов.
+//
+// В режиме ASTAR оценка остатка пути — расстояние по хорде до цели
+// (не больше расстояния по сфере), делённое на скорость автобуса и умноженное на наименьшее по сети
+// отношение дорожного расстояния к прямому (если дороги заданы короче
+// прямой, оценка остаётся нижней границей). Для вершины прибытия на
+// остановку, отличную от цели, к оценке добавляется одно ожидание.
+class TransportRouter {
+ public:
+  // pool используется для precompute_journeys и ComputeMatrix; без него
+  // таблица строится на своём пуле, а матрица считается последовательно
+  TransportRouter(const TransportCatalogue& catalogue, RoutingSettings settings,
+                  ThreadPool* pool = nullptr);
+
+  std::optional<RouteResult> BuildRoute(const Stop* from, const Stop* to) const;
+
+  // Все остановки, до которых из from можно доехать не дольше time_limit
+  // минут, в порядке возрастания времени; from входит с нулевым временем.
+  // Поиск использует рабочие массивы потока, result переиспользуется.
+  void FindReachable(const Stop* from, double time_limit,
+                     std::vector<ReachableStop>& result) const;
+
+  // Время в пути из каждой sources[i] в каждую targets[j] по строкам:
+  // элемент i * targets.size() + j, для недостижимых — nullopt.
+  // Поиск от каждого источника один и останавливается, как только
+  // достигнуты все цели; источники распределяются по пулу.
+  std::vector<std::optional<double>> ComputeMatrix(
+      const std::vector<const Stop*>& sources,
+      const std::vector<const Stop*>& targets) const;
+
+  const RoutingSettings& GetSettings() const;
+
+  const graph::DirectedWeightedGraph<double>& GetGraph() const;
+
+  // nullptr, если search_mode не CONTRACTION_HIERARCHIES
+  const graph::ContractionHierarchy<double>* GetHierarchy() const;
+
+  // nullptr, если precompute_journeys выключен
+  const JourneyTable* GetJourneyTable() const;
+
+ private:
+  enum class EdgeKind { BOARD, RIDE, ALIGHT };
+
+  struct EdgeInfo {
+    EdgeKind kind;
+    const Stop* stop;
+    const Bus* bus;
+  };
+
+  static size_t CountVertices(const TransportCatalogue& catalogue);
+
+  void AddBusEdges(const Bus& bus, const std::vector<const Stop*>& stops);
+
+  // Отпечаток графа для проверки сохранённой таблицы маршрутов
+  uint64_t ComputeFingerprint() const;
+
+  void PrepareJourneyTable(ThreadPool* pool);
+
+  std::optional<RouteResult> BuildTableRoute(const Stop* from,
+                                             const Stop* to) const;
+
+  const TransportCatalogue& catalogue_;
+  RoutingSettings settings_;
+  graph::DirectedWeightedGraph<double> graph_;
+  std::vector<EdgeInfo> edges_info_;
+  std::vector<const Stop*> vertex_stops_;
+  std::vector<detail::SpherePoint> stop_points_;  // по Stop::id_
+  double heuristic_scale_ = 0;  // минут на метр прямого расстояния
+  graph::VertexId next_vertex_ = 0;
+  graph::Router<double> router_;
+  std::optional<graph::ContractionHierarchy<double>> hierarchy_;
+  std::optional<JourneyTable> journey_table_;
+  ThreadPool* pool_ = nullptr;
+};
+
+}  // namespace transpot_guide